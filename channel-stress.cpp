@@ -0,0 +1,161 @@
+/* channel-stress.cpp - stress check for the channel, run by 'make check'.
+ * A producer and a consumer thread push a long numbered stream through
+ * the ring and direct blocks and check it all arrives in order.  Then
+ * the producer repeatedly posts a block and closes while the consumer
+ * may be copying it, poisoning and freeing the block as soon as Close
+ * returns; the consumer must never see the poison.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "channel.h"
+
+#define STREAM_WORDS 2000000 // numbered words in the ordering check
+#define BLOCK_WORDS 300 // largest piece sent or received at once
+#define CLOSE_ROUNDS 2000 // post and close rounds
+#define PATTERN 0x5A5A5A5A // what the posted blocks hold
+#define POISON 0x0BADF00D // what they hold once taken back
+
+static Channel *Shared; // channel the two threads are using
+static int Failures;
+static uint32_t Round; // close round, varies how long the producer waits
+
+// Tiny generator so both threads get varied piece sizes
+static uint32_t Next_random(uint32_t *state) {
+	*state = *state * 1103515245 + 12345;
+	return (*state >> 8) % BLOCK_WORDS + 1;
+}
+
+static void *Stream_producer(void *argument) {
+	int32_t block[BLOCK_WORDS];
+	uint32_t state = 1;
+	int32_t next = 0;
+	while (next < STREAM_WORDS) {
+		uint32_t count = Next_random(&state);
+		if (count > (uint32_t) (STREAM_WORDS - next)) {
+			count = STREAM_WORDS - next;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			block[i] = next + i;
+		}
+		switch (count % 3) {
+			case 0: // one word at a time
+				for (uint32_t i = 0; i < count; i++) {
+					while (!Shared->Send(block[i])) {
+						sched_yield();
+					}
+				}
+				break;
+			case 1: { // what fits
+				uint32_t sent = 0;
+				while ((sent += Shared->Send_some(&block[sent], count - sent)) < count) {
+					sched_yield();
+				}
+				break;
+			}
+			default: // direct, the block must stay put until taken
+				while (!Shared->Send_direct(block, count)) {
+					sched_yield();
+				}
+				break;
+		}
+		next += count;
+	}
+	Shared->Close(CHANNEL_SEND);
+	return NULL;
+}
+
+static void *Stream_consumer(void *argument) {
+	int32_t words[BLOCK_WORDS];
+	uint32_t state = 2;
+	int32_t expected = 0;
+	while (true) {
+		bool closed = Shared->Closed(CHANNEL_SEND); // before receiving
+		uint32_t got = Shared->Receive(words, Next_random(&state));
+		for (uint32_t i = 0; i < got; i++) {
+			if (words[i] != expected++) {
+				fprintf(stderr, "channel-stress: got %d, expected %d\n",
+				  words[i], expected - 1);
+				Failures++;
+				return NULL;
+			}
+		}
+		if (got == 0) {
+			if (closed) {
+				break;
+			}
+			sched_yield();
+		}
+	}
+	if (expected != STREAM_WORDS) {
+		fprintf(stderr, "channel-stress: %d words arrived, %d sent\n",
+		  expected, STREAM_WORDS);
+		Failures++;
+	}
+	return NULL;
+}
+
+static void *Close_producer(void *argument) {
+	int32_t *block = (int32_t *) malloc(BLOCK_WORDS * sizeof(int32_t));
+	for (int i = 0; i < BLOCK_WORDS; i++) {
+		block[i] = PATTERN;
+	}
+	Shared->Send_direct(block, BLOCK_WORDS);
+	for (uint32_t spin = Next_random(&Round) % 50; spin > 0; spin--) {
+		sched_yield();
+	}
+	Shared->Close(CHANNEL_SEND);
+	for (int i = 0; i < BLOCK_WORDS; i++) { // the receiver must be done with it
+		block[i] = POISON;
+	}
+	free(block);
+	return NULL;
+}
+
+static void *Close_consumer(void *argument) {
+	int32_t words[BLOCK_WORDS];
+	while (true) {
+		bool closed = Shared->Closed(CHANNEL_SEND);
+		uint32_t got = Shared->Receive(words, 7);
+		for (uint32_t i = 0; i < got; i++) {
+			if (words[i] != PATTERN) {
+				fprintf(stderr, "channel-stress: copied %08X after close\n",
+				  words[i]);
+				Failures++;
+				return NULL;
+			}
+		}
+		if (got == 0) {
+			if (closed) {
+				return NULL;
+			}
+			sched_yield();
+		}
+	}
+}
+
+// Run a producer and a consumer on a new channel until both finish
+static void Run_pair(void *(*producer)(void *), void *(*consumer)(void *)) {
+	pthread_t threads[2];
+	Shared = new Channel(64);
+	Shared->Attach(CHANNEL_SEND);
+	Shared->Attach(CHANNEL_RECEIVE);
+	pthread_create(&threads[0], NULL, producer, NULL);
+	pthread_create(&threads[1], NULL, consumer, NULL);
+	pthread_join(threads[0], NULL);
+	pthread_join(threads[1], NULL);
+	delete Shared;
+}
+
+int main(void) {
+	Run_pair(Stream_producer, Stream_consumer);
+	for (int round = 0; round < CLOSE_ROUNDS && Failures == 0; round++) {
+		Run_pair(Close_producer, Close_consumer);
+	}
+	if (Failures != 0) {
+		return EXIT_FAILURE;
+	}
+	printf("channel-stress: ok\n");
+	return EXIT_SUCCESS;
+}
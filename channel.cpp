@@ -0,0 +1,128 @@
+/* channel.cpp - one way word channel between two machines in the same
+ * process, see channel.h.*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "channel.h"
+#include "host.h"
+
+Channel::Channel(uint32_t words) {
+	uint32_t size = 16;
+	while (size < words && size < 0x80000000) {
+		size <<= 1;
+	}
+	Ring = (int32_t *) calloc(size, sizeof(int32_t));
+	Mask = size - 1;
+	Ends = 0;
+	Closed_ends = 0;
+	Tail = 0;
+	Block = NULL;
+	Block_start = 0;
+	Block_end = 0;
+	Waiting = false;
+	Revoked = false;
+	Head = 0;
+	Taken = 0;
+	Copying = false;
+}
+
+Channel::~Channel() {
+	free(Ring);
+}
+
+// Channel method to claim an end for a machine's port
+int Channel::Attach(int end) {
+	if (__atomic_fetch_or(&Ends, end, __ATOMIC_ACQ_REL) & end) {
+		return -1;
+	}
+	return 0;
+}
+
+// Channel method to close an end, for good.  Closing the send end takes
+// back any posted block: either the receiver sees Revoked before it
+// starts copying, or we see it copying and wait for it to finish.
+void Channel::Close(int end) {
+	if (end == CHANNEL_SEND) {
+		__atomic_store_n(&Revoked, true, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&Copying, __ATOMIC_SEQ_CST)) {
+			sched_yield();
+		}
+	}
+	__atomic_fetch_or(&Closed_ends, end, __ATOMIC_RELEASE);
+}
+
+bool Channel::Closed(int end) {
+	return (__atomic_load_n(&Closed_ends, __ATOMIC_ACQUIRE) & end) != 0;
+}
+
+// Channel method to put one word in the ring
+bool Channel::Send(int32_t word) {
+	return Send_some(&word, 1) == 1;
+}
+
+// Channel method to put as many words in the ring as there is room for
+uint32_t Channel::Send_some(const int32_t *words, uint32_t count) {
+	uint64_t head = __atomic_load_n(&Head, __ATOMIC_ACQUIRE);
+	uint32_t room = Mask + 1 - (uint32_t) (Tail - head);
+	if (count > room) {
+		count = room;
+	}
+	uint32_t at = Tail & Mask;
+	uint32_t first = count < Mask + 1 - at ? count : Mask + 1 - at; // up to the wrap
+	Copy_words(&Ring[at], words, first);
+	Copy_words(Ring, &words[first], count - first);
+	__atomic_store_n(&Tail, Tail + count, __ATOMIC_RELEASE);
+	return count;
+}
+
+// Channel method for a direct block send.  The first call posts the
+// block, later calls check on it; true once the receiver has copied
+// it all, until then the sender must leave the words alone.
+bool Channel::Send_direct(const int32_t *words, uint32_t count) {
+	if (Waiting) {
+		if (__atomic_load_n(&Taken, __ATOMIC_ACQUIRE) != Block_end) {
+			return false;
+		}
+		Waiting = false;
+		return true;
+	}
+	if (count == 0) {
+		return true;
+	}
+	Block = words;
+	Block_start = Block_end;
+	__atomic_store_n(&Block_end, Block_end + count, __ATOMIC_RELEASE);
+	Waiting = true;
+	return false;
+}
+
+// Channel method to take up to count words.  Ring words come first,
+// they were sent before any posted block, then the block is copied
+// straight from the sender's memory.
+uint32_t Channel::Receive(int32_t *words, uint32_t count) {
+	// block first, so ring words sent before it are seen below
+	uint64_t block_end = __atomic_load_n(&Block_end, __ATOMIC_ACQUIRE);
+	uint64_t tail = __atomic_load_n(&Tail, __ATOMIC_ACQUIRE);
+
+	uint32_t waiting = (uint32_t) (tail - Head);
+	uint32_t done = count < waiting ? count : waiting;
+	uint32_t at = Head & Mask;
+	uint32_t first = done < Mask + 1 - at ? done : Mask + 1 - at;
+	Copy_words(words, &Ring[at], first);
+	Copy_words(&words[first], Ring, done - first);
+	__atomic_store_n(&Head, Head + done, __ATOMIC_RELEASE);
+
+	if (done < count && done == waiting && Taken < block_end) { // ring empty
+		__atomic_store_n(&Copying, true, __ATOMIC_SEQ_CST);
+		if (!__atomic_load_n(&Revoked, __ATOMIC_SEQ_CST)) { // still there
+			uint32_t left = (uint32_t) (block_end - Taken);
+			uint32_t more = count - done < left ? count - done : left;
+			Copy_words(&words[done], &Block[Taken - Block_start], more);
+			__atomic_store_n(&Taken, Taken + more, __ATOMIC_RELEASE);
+			done += more;
+		}
+		__atomic_store_n(&Copying, false, __ATOMIC_RELEASE);
+	}
+	return done;
+}
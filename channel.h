@@ -0,0 +1,63 @@
+/* channel.h - one way word channel between two machines in the same
+ * process.  Shared by the library, outside code uses the C interface
+ * in libmachine.h.*/
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdint.h>
+
+#define CHANNEL_SEND 1 // the end a machine's port is connected to
+#define CHANNEL_RECEIVE 2
+#define CHANNEL_LINE 64 // keep the two ends' fields on separate cache lines
+
+//********************************************************************
+// Class to implement a channel.  Single producer, single consumer, so
+// the ring needs no locks, only acquire and release on the indexes.
+// Words can go through the ring, or a direct block send posts the
+// sender's memory and the receiver copies straight out of it, no ring
+// in between.  Closing the send end takes back a posted block, so the
+// sender's memory can go once Close returns.  Nothing else here ever
+// waits, the instructions using it just run again until they can finish.
+//********************************************************************
+class Channel
+{
+
+	public:
+		Channel(uint32_t words);	// Constructor, ring size rounded up to a power of two
+		~Channel();	// Destructor
+		bool Ok() { return Ring != NULL; } // ring was allocated
+		int Attach(int end); // claim an end, -1 if it was already taken
+		void Close(int end); // the machine on that end is finished with it
+		bool Closed(int end); // has the given end been closed
+
+		// sender end
+		bool Send(int32_t word); // false if the ring is full
+		uint32_t Send_some(const int32_t *words, uint32_t count); // what fits
+		bool Send_direct(const int32_t *words, uint32_t count); // true once all taken
+
+		// receiver end
+		uint32_t Receive(int32_t *words, uint32_t count); // what is waiting
+
+	private:
+
+		int32_t *Ring;	// the words
+		uint32_t Mask;	// ring size - 1
+		int Ends;	// CHANNEL_SEND and CHANNEL_RECEIVE once attached
+		int Closed_ends;	// written by either end with atomics
+
+		// written by the sender
+		alignas(CHANNEL_LINE) uint64_t Tail;	// words ever put in the ring
+		const int32_t *Block;	// posted by Send_direct
+		uint64_t Block_start;	// Taken count where Block begins
+		uint64_t Block_end;	// and ends, published last
+		bool Waiting;	// a direct block is outstanding
+		bool Revoked;	// the sender closed, Block may be gone
+
+		// written by the receiver
+		alignas(CHANNEL_LINE) uint64_t Head;	// words ever taken from the ring
+		uint64_t Taken;	// words ever taken from direct blocks
+		bool Copying;	// inside a copy out of Block
+};
+
+#endif
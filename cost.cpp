@@ -0,0 +1,137 @@
+/* cost.cpp - cycle cost model for estimating how long programs would
+ * take on the real hardware, see cost.h.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cost.h"
+
+// Class names used in cost files, in COST_* order
+static const char *Cost_names[COST_CLASSES] = {
+	"memory", "branch", "call", "atomic", "immediate", "shift", "shift_bit",
+	"register", "skip_taken", "skip_not_taken", "single", "io", "return", "misc"
+};
+
+// Costs until a file says otherwise, in COST_* order
+static const uint32_t Default_costs[COST_CLASSES] = {
+	2, 2, 3, 4, 1, 1, 1, 1, 2, 1, 1, 8, 3, 1
+};
+
+CostModel::CostModel() {
+	memcpy(Cost, Default_costs, sizeof(Cost));
+	Block_cycles = (uint64_t *) calloc(MEMORY_SIZE * 4, sizeof(uint64_t));
+	Block_runs = NULL;
+	Function_cycles = NULL;
+	Function_runs = NULL;
+	if (Block_cycles != NULL) { // one allocation for all four tables
+		Block_runs = Block_cycles + MEMORY_SIZE;
+		Function_cycles = Block_runs + MEMORY_SIZE;
+		Function_runs = Function_cycles + MEMORY_SIZE;
+	}
+	Reset(0);
+}
+
+CostModel::~CostModel() {
+	free(Block_cycles);
+}
+
+// CostModel method to read a cost file.  Each line is a class name and
+// its cycles in decimal, '#' starts a comment, classes not named keep
+// their cost.
+int CostModel::Load(const char *path) {
+	FILE *input = fopen(path, "r");
+	if (input == NULL) {
+		return -1;
+	}
+	uint32_t costs[COST_CLASSES];
+	memcpy(costs, Cost, sizeof(costs));
+	char line[256];
+	int status = 0;
+	while (status == 0 && fgets(line, sizeof(line), input) != NULL) {
+		char *comment = strchr(line, '#');
+		if (comment != NULL) {
+			*comment = 0;
+		}
+		char name[32];
+		unsigned int cycles;
+		int fields = sscanf(line, "%31s %u", name, &cycles);
+		if (fields <= 0) { // blank line
+			continue;
+		}
+		status = -1;
+		for (int i = 0; fields == 2 && i < COST_CLASSES; i++) {
+			if (strcmp(name, Cost_names[i]) == 0) {
+				costs[i] = cycles;
+				status = 0;
+			}
+		}
+	}
+	fclose(input);
+	if (status == 0) {
+		memcpy(Cost, costs, sizeof(Cost));
+	}
+	return status;
+}
+
+// CostModel method to clear the totals
+void CostModel::Reset(uint32_t pc) {
+	if (Block_cycles != NULL) {
+		memset(Block_cycles, 0, MEMORY_SIZE * 4 * sizeof(uint64_t));
+	}
+	Cycles = 0;
+	Block_start = COST_ADDRESS(pc);
+	Block_sum = 0;
+	Function = COST_ADDRESS(pc);
+	Depth = 0;
+}
+
+// CostModel method to charge the cycles of the block in progress
+// without ending it, so totals are right when a run stops mid-block
+void CostModel::Flush() {
+	Block_cycles[Block_start] += Block_sum;
+	Function_cycles[Function] += Block_sum;
+	Block_sum = 0;
+}
+
+// CostModel method to finish a block and start the next one at next
+void CostModel::End_block(uint32_t next) {
+	Block_runs[Block_start]++;
+	Flush();
+	Block_start = COST_ADDRESS(next);
+}
+
+// CostModel methods to list the blocks or functions taking the most
+// cycles, most first.  Return how many were listed.
+int CostModel::Blocks(uint32_t *addresses, uint64_t *counts, uint64_t *cycles,
+  int max) {
+	Flush();
+	return Top(Block_cycles, Block_runs, addresses, counts, cycles, max);
+}
+
+int CostModel::Functions(uint32_t *addresses, uint64_t *counts,
+  uint64_t *cycles, int max) {
+	Flush();
+	return Top(Function_cycles, Function_runs, addresses, counts, cycles, max);
+}
+
+// Insertion into a short sorted list, max is small so this is plenty
+int CostModel::Top(const uint64_t *by_cycles, const uint64_t *by_count,
+  uint32_t *addresses, uint64_t *counts, uint64_t *cycles, int max) {
+	int listed = 0;
+	for (uint32_t address = 0; address < MEMORY_SIZE; address++) {
+		uint64_t spent = by_cycles[address];
+		if (spent == 0 || (listed == max && spent <= cycles[max - 1])) {
+			continue;
+		}
+		int i = listed < max ? listed++ : max - 1;
+		for (; i > 0 && cycles[i - 1] < spent; i--) { // make room
+			addresses[i] = addresses[i - 1];
+			counts[i] = counts[i - 1];
+			cycles[i] = cycles[i - 1];
+		}
+		addresses[i] = address;
+		counts[i] = by_count[address];
+		cycles[i] = spent;
+	}
+	return listed;
+}
@@ -0,0 +1,128 @@
+/* cost.h - cycle cost model for estimating how long programs would take
+ * on the real hardware.  Shared by the library, outside code uses the
+ * C interface in libmachine.h.*/
+
+#ifndef COST_H
+#define COST_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Instruction classes, each has its own cost in cycles
+#define COST_MEMORY 0 // X7 load, store, add and subtract memory
+#define COST_BRANCH 1 // X7 branch
+#define COST_CALL 2 // X7 call
+#define COST_ATOMIC 3 // X7 fetch and add, compare and swap
+#define COST_IMMEDIATE 4 // X6
+#define COST_SHIFT 5 // X5, plus COST_SHIFT_BIT for each place shifted
+#define COST_SHIFT_BIT 6
+#define COST_REGISTER 7 // X4 register to register
+#define COST_SKIP_TAKEN 8 // X4 skips
+#define COST_SKIP_NOT_TAKEN 9
+#define COST_SINGLE 10 // X3
+#define COST_IO 11 // X2
+#define COST_RETURN 12 // X1 return
+#define COST_MISC 13 // other X1
+#define COST_CLASSES 14
+
+#define COST_STACK 256 // call depth followed, deeper calls stay in the caller
+#define COST_ADDRESS(a) ((a) & (MEMORY_SIZE - 1)) // table index, memory is a power of two
+
+//********************************************************************
+// Class to implement the cost model.  Cycles are added up per basic
+// block, a block ending at any control transfer, and each finished
+// block is charged to the function it ran in.  A function is the
+// target of a CALL, and runs until the matching return.
+//********************************************************************
+class CostModel
+{
+
+	public:
+		CostModel();	// Constructor, default costs
+		~CostModel();	// Destructor
+		bool Ok() { return Block_cycles != NULL; } // tables were allocated
+		int Load(const char *path); // read "class cycles" lines, 0 or -1
+		void Reset(uint32_t pc); // clear the totals, starting in a function at pc
+		void Flush(); // charge the block in progress
+		int Blocks(uint32_t *addresses, uint64_t *counts, uint64_t *cycles, int max);
+		int Functions(uint32_t *addresses, uint64_t *counts, uint64_t *cycles, int max);
+		uint64_t Cycles;	// total since the reset
+
+		// Account for an instruction that ran at pc, next is the new pc
+		inline void Account(int32_t instruction, uint32_t pc, uint32_t next) {
+			uint32_t cycles = Instruction_cost(instruction, next == pc + 2);
+			Cycles += cycles;
+			Block_sum += cycles;
+			if (next == pc + 1) { // still in the block
+				return;
+			}
+			End_block(next);
+			if (((instruction >> 28) & 0x0000000F) == 6) { // call
+				if (Depth < COST_STACK) {
+					Stack[Depth] = Function;
+					Function = COST_ADDRESS(next);
+					Function_runs[Function]++;
+				}
+				Depth++;
+			}
+			else if ((instruction & 0xFFFFFFF0) == 0x00000020 && Depth > 0) { // return
+				Depth--;
+				if (Depth < COST_STACK) {
+					Function = Stack[Depth];
+				}
+			}
+		}
+
+	private:
+
+		uint32_t Cost[COST_CLASSES];	// cycles for each class
+		uint64_t *Block_cycles;	// by address of the block's first instruction
+		uint64_t *Block_runs;
+		uint64_t *Function_cycles;	// by entry address, not counting callees
+		uint64_t *Function_runs;
+		uint32_t Block_start;	// block in progress
+		uint64_t Block_sum;	// and its cycles so far
+		uint32_t Function;	// function in progress
+		uint32_t Stack[COST_STACK];	// callers
+		int Depth;	// calls in progress, may be more than COST_STACK
+
+		// Cycles for one instruction, decoded the way Execute does
+		inline uint32_t Instruction_cost(int32_t instruction, bool skipped) {
+			if ((instruction & 0xF0000000) != 0) {
+				switch ((instruction >> 28) & 0x0000000F) {
+					case 5: return Cost[COST_BRANCH];
+					case 6: return Cost[COST_CALL];
+					case 7:
+					case 8: return Cost[COST_ATOMIC];
+					default: return Cost[COST_MEMORY];
+				}
+			}
+			if ((instruction & 0x0F000000) != 0) {
+				return Cost[COST_IMMEDIATE];
+			}
+			if ((instruction & 0x00F00000) != 0) {
+				return Cost[COST_SHIFT] + Cost[COST_SHIFT_BIT] * (instruction & 0x0000001F);
+			}
+			if ((instruction & 0x000F0000) != 0) {
+				if (((instruction >> 16) & 0x0000000F) < 7) {
+					return Cost[COST_REGISTER];
+				}
+				return skipped ? Cost[COST_SKIP_TAKEN] : Cost[COST_SKIP_NOT_TAKEN];
+			}
+			if ((instruction & 0x0000F000) != 0) {
+				return Cost[COST_SINGLE];
+			}
+			if ((instruction & 0x00000F00) != 0) {
+				return Cost[COST_IO];
+			}
+			if ((instruction & 0x000000F0) == 0x00000020) {
+				return Cost[COST_RETURN];
+			}
+			return Cost[COST_MISC];
+		}
+		void End_block(uint32_t next);
+		int Top(const uint64_t *by_cycles, const uint64_t *by_count,
+		  uint32_t *addresses, uint64_t *counts, uint64_t *cycles, int max);
+};
+
+#endif
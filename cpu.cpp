@@ -0,0 +1,1660 @@
+/* cpu.cpp - CPU and block device for the emulated hypothetical computer.
+ * Procedure oriented and in-line code rather than class oriented code
+ * is used quite a bit for speed.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cpu.h"
+#include "cost.h"
+#include "host.h"
+
+//********************************************************************
+// Block storage device
+//********************************************************************
+
+// BlockDevice constructor - nothing attached yet
+BlockDevice::BlockDevice(void) {
+	Map = NULL;
+	Sectors = 0;
+	Path[0] = 0;
+}
+
+// BlockDevice destructor - make sure the file gets written back
+BlockDevice::~BlockDevice(void) {
+	Detach();
+}
+
+// BlockDevice method to attach a host file.  If sectors is non-zero the
+// file is created or extended to that many sectors, otherwise it must
+// already exist and its size is used (a partial last sector is ignored).
+int BlockDevice::Attach(const char *path, int32_t sectors) {
+
+	Detach(); // only one file at a time
+
+	if (strlen(path) >= sizeof(Path)) { // couldn't report it back
+		return -1;
+	}
+	int fd = open(path, sectors > 0 ? O_RDWR | O_CREAT : O_RDWR, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	off_t size = st.st_size;
+	off_t sector_bytes = SECTOR_SIZE * sizeof(int32_t);
+
+	if (sectors > 0 && size < sectors * sector_bytes) { // grow the file
+		size = sectors * sector_bytes;
+		if (ftruncate(fd, size) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	int32_t count = size / sector_bytes ;
+	if (count == 0) { // nothing usable in the file
+		close(fd);
+		return -1;
+	}
+
+	void *map = mmap(NULL, count * sector_bytes, PROT_READ | PROT_WRITE,
+	  MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps its own reference
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+
+	Map = (int32_t *) map;
+	Sectors = count;
+	strcpy(Path, path);
+	return 0;
+}
+
+// BlockDevice method to write back and release the mapping
+void BlockDevice::Detach(void) {
+	if (Map != NULL) {
+		size_t bytes = (size_t) Sectors * SECTOR_SIZE * sizeof(int32_t);
+		msync(Map, bytes, MS_SYNC);
+		munmap(Map, bytes);
+	}
+	Map = NULL;
+	Sectors = 0;
+	Path[0] = 0;
+}
+
+// BlockDevice method to move sectors between the file and Memory.
+// The control block is three words: sector number, memory address
+// and sector count.  Breakpoint traps are kept out of the file and
+// put back over words read in.  Returns one of the BLOCK_ status codes.
+int BlockDevice::Transfer(int32_t *memory, int32_t *control, bool write,
+  CPU *owner) {
+
+	if (Map == NULL) {
+		return BLOCK_NO_DEVICE;
+	}
+
+	uint32_t sector = __atomic_load_n(&control[0], __ATOMIC_RELAXED);
+	uint32_t address = __atomic_load_n(&control[1], __ATOMIC_RELAXED);
+	uint32_t count = __atomic_load_n(&control[2], __ATOMIC_RELAXED);
+
+	if (sector > (uint32_t) Sectors || count > (uint32_t) Sectors - sector) {
+		return BLOCK_BAD_SECTOR;
+	}
+	if (address > MEMORY_SIZE ||
+	  count > (MEMORY_SIZE - address) / SECTOR_SIZE) {
+		return BLOCK_BAD_ADDRESS;
+	}
+
+	int32_t *disk = Map + (size_t) sector * SECTOR_SIZE;
+	size_t words = (size_t) count * SECTOR_SIZE;
+	if (write) {
+		owner->Copy_memory(disk, &memory[address], words);
+		owner->Hide_breakpoints(address, disk, words);
+	}
+	else {
+		owner->Copy_memory(&memory[address], disk, words);
+		owner->Refresh_breakpoints(address, words);
+		owner->Code_written(address, words);
+	}
+	return BLOCK_OK;
+}
+
+//********************************************************************
+// Class to implement the CPU
+//********************************************************************
+
+// Default console I/O hooks, plain stdio
+static int Stdio_read(void *context) {
+	return getchar();
+}
+
+static void Stdio_write(void *context, int c) {
+	putchar(c);
+}
+
+// CPU constructor  - set up object and clear memory and registers.
+// A secondary core shares the primary's memory, devices, breakpoints
+// and watchpoints, and starts with a copy of its registers.
+CPU::CPU(CPU *primary) {
+	Reset_counters();
+	Break_count = 0;
+	Watch_count = 0;
+	Rebuild_watch_pages();
+	memset(Page_flags, 0, sizeof(Page_flags));
+	Block_start = 0;
+	Cores = 1;
+	Blocks = (Block_summary *) calloc(MEMORY_SIZE, sizeof(Block_summary));
+	Code_generation = 1; // calloc'ed summaries are stale
+	memset(Code_map, 0, sizeof(Code_map));
+	Restored = NULL;
+	for (int i = 0; i < MAX_PORTS; i++) {
+		Ports[i] = NULL;
+		Staged[i] = NULL;
+	}
+
+	if (primary != NULL) { // secondary core
+		Primary = primary;
+		__atomic_fetch_add(&primary->Cores, 1, __ATOMIC_RELAXED);
+		for (int i = 0; i<NUM_REGISTERS; i++){	//Copy the registers
+			Regs[i] = primary->Regs[i];
+		};
+		Memory = primary->Memory;
+		Set_io(primary->Reader, primary->Writer, primary->Io_context);
+		Core_id = 0; // numbered by whoever creates the cores
+		Coverage = NULL;
+		Touched = NULL;
+		Touched_count = 0;
+		Prev_location = 0;
+		Timing = NULL;
+		return;
+	}
+
+	Primary = this;
+	for (int i = 0; i<NUM_REGISTERS; i++){	//Clear the registers
+		Regs[i] = 0;
+	};
+	Memory = (int32_t *) calloc(MEMORY_SIZE, sizeof(int32_t)); // cleared
+	Set_io(NULL, NULL, NULL);
+	Core_id = 0;
+	Coverage = NULL;
+	Touched = NULL;
+	Touched_count = 0;
+	Prev_location = 0;
+	Timing = NULL;
+};
+
+// CPU destructor - give back the memory if it is ours
+CPU::~CPU(void) {
+	free(Blocks);
+	if (Primary != this) {
+		__atomic_fetch_sub(&Primary->Cores, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		for (int i = 0; i < MAX_PORTS; i++) {
+			Disconnect(i);
+		}
+		free(Memory);
+	}
+}
+
+// CPU method to zero the statistics and performance counters
+void CPU::Reset_counters(void) {
+	Instructions = 0;
+	Branches = 0;
+	Calls = 0;
+	Loads = 0;
+	Stores = 0;
+	Io_operations = 0;
+	Chars_in = 0;
+	Chars_out = 0;
+	Sectors_read = 0;
+	Sectors_written = 0;
+}
+
+// CPU method to copy out memory and registers, showing the original
+// words where breakpoints are
+void CPU::Snapshot(int32_t *memory, int32_t *regs) {
+	memcpy(memory, Memory, MEMORY_SIZE * sizeof(int32_t));
+	Primary->Hide_breakpoints(0, memory, MEMORY_SIZE);
+	memcpy(regs, Regs, sizeof(Regs));
+}
+
+// CPU method to go back to a snapshot.  Going back to the same copy
+// again only copies the pages written since, so the copy must not
+// change in between.  Breakpoint traps on the copied pages go back in,
+// with the snapshot's words as the saved ones.
+void CPU::Restore(const int32_t *memory, const int32_t *regs) {
+	CPU *p = Primary;
+	if (memory != p->Restored) { // nothing is known to match it
+		for (int page = 0; page < WATCH_PAGES; page++) {
+			__atomic_fetch_and(&p->Page_flags[page], (uint8_t) ~PAGE_CLEAN,
+			  __ATOMIC_RELAXED);
+		}
+		p->Restored = memory;
+	}
+	for (int page = 0; page < WATCH_PAGES; page++) {
+		uint32_t address = page << WATCH_PAGE_SHIFT;
+		if ((Flags_of(address) & PAGE_CLEAN) == 0) {
+			memcpy(&Memory[address], &memory[address],
+			  sizeof(int32_t) << WATCH_PAGE_SHIFT);
+			p->Refresh_breakpoints(address, 1u << WATCH_PAGE_SHIFT);
+			Code_written(address, 1u << WATCH_PAGE_SHIFT);
+			__atomic_fetch_or(&p->Page_flags[page], (uint8_t) PAGE_CLEAN,
+			  __ATOMIC_RELAXED);
+		}
+	}
+	memcpy(Regs, regs, sizeof(Regs));
+}
+
+// CPU method to connect a port to one end of a channel, each end can
+// only be connected once
+int CPU::Connect(int port, Channel *channel, int end) {
+	if (port < 0 || port >= MAX_PORTS || Primary->Ports[port] != NULL ||
+	  channel->Attach(end) != 0) {
+		return -1;
+	}
+	Primary->Ports[port] = channel;
+	Primary->Port_end[port] = end;
+	return 0;
+}
+
+// CPU method to close a port's end of its channel and let the port go
+void CPU::Disconnect(int port) {
+	if (port >= 0 && port < MAX_PORTS && Primary->Ports[port] != NULL) {
+		Primary->Ports[port]->Close(Primary->Port_end[port]);
+		Primary->Ports[port] = NULL;
+		free(Primary->Staged[port]);
+		Primary->Staged[port] = NULL;
+	}
+}
+
+// CPU method for a device to copy words to or from memory.  Other
+// cores, or machines reading a posted block, may be using memory at the
+// same time, so the copy is made with atomics unless nothing else can
+// be; a single core with no channels gets a plain memcpy.
+void CPU::Copy_memory(int32_t *to, const int32_t *from, size_t count) {
+	bool shared = __atomic_load_n(&Primary->Cores, __ATOMIC_RELAXED) > 1;
+	for (int i = 0; i < MAX_PORTS && !shared; i++) {
+		shared = Primary->Ports[i] != NULL;
+	}
+	if (shared) {
+		Copy_words(to, from, count);
+	}
+	else {
+		memcpy(to, from, count * sizeof(int32_t));
+	}
+}
+
+// CPU method to close all our channel ends, the machines on the other
+// ends see the channel closed once it empties
+void CPU::Close_ports() {
+	for (int i = 0; i < MAX_PORTS; i++) {
+		if (Primary->Ports[i] != NULL) {
+			Primary->Ports[i]->Close(Primary->Port_end[i]);
+		}
+	}
+}
+
+// CPU method to install console I/O hooks, NULL restores stdio
+void CPU::Set_io(Read_hook reader, Write_hook writer, void *context) {
+	Reader = (reader != NULL) ? reader : Stdio_read;
+	Writer = (writer != NULL) ? writer : Stdio_write;
+	Io_context = context;
+}
+
+// CPU method to obtain register value (no value checking, do externally)
+int32_t CPU::Get_register_value(int register_number) {
+
+		return (Regs[ register_number ]);
+
+}
+
+// CPU method to store a value in a register (no value checking, do externally)
+int CPU::Store_value_in_register (int register_number, int32_t value) {
+	Regs [register_number] = value ;
+	return 0 ;
+}
+
+// CPU method to handle instruction single step
+int CPU::Step(void) {
+
+	if (Primary->Watch_count != 0 || Timing != NULL) { // let the checking loop do it
+		return Run_watched(1);
+	}
+
+	uint32_t address = Regs[PCR_REGISTER];
+	Block_start = address;
+	int status = Execute_at(address); // just the one instruction
+	if (status == INSTRUCTION_WAIT) { // stepped nothing, try again next time
+		sched_yield();
+		return 0;
+	}
+	if (status == 0 && (uint32_t) Regs[PCR_REGISTER] != address + 1) {
+		End_block(address, Regs[PCR_REGISTER]);
+	}
+	Account_to(Regs[PCR_REGISTER]);
+	if (status == 0 && Is_breakpoint(Regs[PCR_REGISTER])) { // stopping on one
+		status = INSTRUCTION_BREAKPOINT;
+	}
+	return status; // just return with execution code
+}
+
+// CPU method to run until an instruction stops us or limit instructions
+// have been executed.  Returns 0 if the limit ran out.  Breakpoints
+// cost nothing here, they are trap instructions patched into memory.
+// Nothing is counted per instruction, the loop only notices where a
+// basic block ends and the counters are added up for the whole block.
+// If the limit runs out with the PC on a breakpoint that is reported,
+// as the next run would step over it.
+int CPU::Run(uint64_t limit) {
+
+	// only pay for watchpoints and timing when they are wanted
+	if (Primary->Watch_count != 0 || Timing != NULL) {
+		return Run_watched(limit);
+	}
+
+	uint64_t left = limit; // a limit of 0 never comes up
+	uint32_t address = Regs[PCR_REGISTER];
+	Block_start = address;
+	int status = Execute_at(address); // may resume from a breakpoint
+	while (true) {
+		if (status != 0) {
+			if (status != INSTRUCTION_WAIT) {
+				break;
+			}
+			sched_yield(); // nothing retired, let the other end get on
+			if (--left == 0) {
+				status = 0;
+				break;
+			}
+			status = Execute_at(address); // a breakpoint may be here
+			continue;
+		}
+		uint32_t next = Regs[PCR_REGISTER];
+		if (next != address + 1) { // the block ended with that one
+			End_block(address, next);
+		}
+		if (--left == 0) {
+			if (Is_breakpoint(next)) {
+				status = INSTRUCTION_BREAKPOINT;
+			}
+			break;
+		}
+		address = next;
+		if (address >= MEMORY_SIZE) { // ran off the end of memory
+			status = INSTRUCTION_ADDRESS_FAULT;
+			break;
+		}
+		status = Execute(Fetch_word(address));
+	}
+	Account_to(Regs[PCR_REGISTER]);
+
+	return status;
+}
+
+// CPU method for Run when watchpoints are set or the cost model is on.
+// Each instruction has its memory operands checked first, which only
+// costs a page lookup unless the page holds a watched word.  The run
+// stops after the instruction that touched the watched word.  With
+// timing, each instruction is charged once it has run.
+int CPU::Run_watched(uint64_t limit) {
+
+	uint64_t left = limit;
+	bool first = true;
+	int status = 0;
+	Block_start = Regs[PCR_REGISTER];
+	do {
+		uint32_t address = Regs[PCR_REGISTER];
+		if (address >= MEMORY_SIZE) { // ran off the end of memory
+			status = INSTRUCTION_ADDRESS_FAULT;
+			break;
+		}
+		int32_t instruction = Fetch_word(address);
+		if (first && instruction == BREAKPOINT_TRAP) { // resuming?
+			int i = Find_breakpoint(address);
+			if (i >= 0) {
+				instruction = Primary->Break_saved[i];
+				if (instruction == BREAKPOINT_TRAP) { // the program stored one
+					status = INSTRUCTION_INVALID;
+					break;
+				}
+			}
+		}
+		bool hit = Primary->Watch_count != 0 && Check_watch(instruction);
+		status = Execute(instruction);
+		if (status == INSTRUCTION_WAIT && !hit) { // nothing retired, go again
+			sched_yield();
+			status = 0;
+			continue; // still first if we were resuming
+		}
+		if (status != 0) {
+			if (status == INSTRUCTION_WAIT) { // part of a block moved
+				status = INSTRUCTION_WATCHPOINT;
+			}
+			break;
+		}
+		uint32_t next = Regs[PCR_REGISTER];
+		if (Timing != NULL) {
+			Timing->Account(instruction, address, next);
+		}
+		if (next != address + 1) {
+			End_block(address, next);
+		}
+		first = false;
+		if (hit) {
+			status = INSTRUCTION_WATCHPOINT;
+			break;
+		}
+	} while (--left != 0);
+	Account_to(Regs[PCR_REGISTER]);
+	// the limit ran out, report a breakpoint we got to like Run does
+	if (status == 0 && !first && Is_breakpoint(Regs[PCR_REGISTER])) {
+		status = INSTRUCTION_BREAKPOINT;
+	}
+
+	return status;
+}
+
+// CPU method to execute the instruction at address, using the saved
+// word if a breakpoint trap is sitting there.  Used to get going again
+// after a breakpoint has stopped us.
+int CPU::Execute_at(uint32_t address) {
+
+	if (address >= MEMORY_SIZE) { // ran off the end of memory
+		return INSTRUCTION_ADDRESS_FAULT;
+	}
+	int32_t instruction = Fetch_word(address);
+	if (instruction == BREAKPOINT_TRAP) {
+		int i = Find_breakpoint(address);
+		if (i >= 0) {
+			instruction = Primary->Break_saved[i];
+			if (instruction == BREAKPOINT_TRAP) { // the program stored one
+				return INSTRUCTION_INVALID;
+			}
+		}
+	}
+	return Execute(instruction);
+}
+
+// CPU method to find a breakpoint, returns its index or -1
+int CPU::Find_breakpoint(uint32_t address) {
+	CPU *p = Primary; // breakpoints are kept by the primary core
+	for (int i = 0; i < p->Break_count; i++) {
+		if (p->Break_address[i] == address) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// CPU method to find the word the program sees at an address, the
+// saved word if a breakpoint trap sits there.  Only called for a
+// trap word or a flagged page, so the common case never gets here.
+int32_t *CPU::Word_at(uint32_t address) {
+	CPU *p = Primary;
+	if (Flags_of(address) & PAGE_BREAK) {
+		int i = Find_breakpoint(address);
+		if (i >= 0) {
+			return &p->Break_saved[i];
+		}
+	}
+	return &Memory[address];
+}
+
+// CPU method for a store to a flagged page, the saved word takes it if
+// a breakpoint trap is there and summaries of code it hits go stale
+void CPU::Store_flagged(uint32_t address, int32_t value) {
+	__atomic_store_n(Word_at(address), value, __ATOMIC_RELAXED);
+	Code_stored(address);
+}
+
+// CPU method to check a store against the summarized code, and note
+// the page no longer matches the restored copy
+void CPU::Code_stored(uint32_t address) {
+	Page_written(address);
+	if ((Flags_of(address) & PAGE_CODE) && Is_code(address)) {
+		Forget_code();
+	}
+}
+
+// CPU method to check memory written by a device or the host against
+// the summarized code, the pages no longer match the restored copy
+void CPU::Code_written(uint32_t address, uint32_t count) {
+	uint32_t end = count > MEMORY_SIZE - address ? MEMORY_SIZE : address + count;
+	for (uint32_t at = address; at < end;
+	  at = (at | ((1u << WATCH_PAGE_SHIFT) - 1)) + 1) {
+		Page_written(at);
+	}
+	for (uint32_t at = address; at < end; at++) {
+		if ((Flags_of(at) & PAGE_CODE) == 0) {
+			at |= (1u << WATCH_PAGE_SHIFT) - 1; // skip the page
+		}
+		else if (Is_code(at)) {
+			Forget_code();
+			return;
+		}
+	}
+}
+
+// CPU method to make every block summary stale, on all the cores.  The
+// marks are cleared before the generation moves on, so a core that
+// sees the new generation in Summarize never has its marks wiped.
+void CPU::Forget_code(void) {
+	CPU *p = Primary;
+	for (int i = 0; i < MEMORY_SIZE / 32; i++) {
+		if (__atomic_load_n(&p->Code_map[i], __ATOMIC_RELAXED) != 0) {
+			__atomic_store_n(&p->Code_map[i], 0, __ATOMIC_RELAXED);
+		}
+	}
+	for (int page = 0; page < WATCH_PAGES; page++) {
+		__atomic_fetch_and(&p->Page_flags[page], (uint8_t) ~PAGE_CODE,
+		  __ATOMIC_RELAXED);
+	}
+	if (__atomic_add_fetch(&p->Code_generation, 1, __ATOMIC_RELEASE) == 0) {
+		__atomic_add_fetch(&p->Code_generation, 1, __ATOMIC_RELEASE); // 0 is never used
+	}
+}
+
+// Memory words an instruction reads and writes, decoded the way
+// Execute does.  A compare and swap only writes if it swaps, that store
+// is counted when it happens.
+static void Count_accesses(int32_t instruction, uint32_t *loads,
+  uint32_t *stores) {
+	if ((instruction & 0xF0000000) != 0) { // memory reference
+		switch ((instruction >> 28) & 0x0000000F) {
+			case 1: // load, add and subtract
+			case 3:
+			case 4:
+			case 8: // compare and swap
+				(*loads)++;
+				break;
+			case 2: // store
+			case 6: // call pushes the return address
+				(*stores)++;
+				break;
+			case 7: // fetch and add
+				(*loads)++;
+				(*stores)++;
+				break;
+		}
+	}
+	else if ((instruction & 0xFFFF0000) != 0) { // no memory operands
+	}
+	else if ((instruction & 0x0000F000) != 0) { // single register
+		int code = (instruction >> 12) & 0x0000000F;
+		if (code == 4) { // push
+			(*stores)++;
+		}
+		else if (code == 5) { // pop
+			(*loads)++;
+		}
+	}
+	else if ((instruction & 0x00000F00) == 0 &&
+	  (instruction & 0x000000F0) == 0x00000020) { // return pops the stack
+		(*loads)++;
+	}
+}
+
+// CPU method to count the loads and stores of a block by looking at its
+// instructions, keeping a summary for next time.  The words are marked
+// as code first so a store to them makes the summary stale.
+void CPU::Summarize(uint32_t start, uint32_t length) {
+	CPU *p = Primary;
+	uint32_t generation = __atomic_load_n(&p->Code_generation, __ATOMIC_ACQUIRE);
+	uint32_t loads = 0;
+	uint32_t stores = 0;
+	for (uint32_t at = start; at - start < length && at < MEMORY_SIZE; at++) {
+		if (!Is_code(at)) {
+			__atomic_fetch_or(&p->Code_map[at >> 5], 1u << (at & 31),
+			  __ATOMIC_RELAXED);
+		}
+		if ((Flags_of(at) & PAGE_CODE) == 0) {
+			__atomic_fetch_or(&p->Page_flags[at >> WATCH_PAGE_SHIFT],
+			  (uint8_t) PAGE_CODE, __ATOMIC_RELAXED);
+		}
+		Count_accesses(Load_word(at), &loads, &stores);
+	}
+	Loads += loads;
+	Stores += stores;
+	if (Blocks != NULL && length <= MAX_SUMMARY) {
+		Block_summary *block = &Blocks[start];
+		block->generation = generation;
+		block->length = length;
+		block->loads = loads;
+		block->stores = stores;
+	}
+}
+
+// CPU method to flag the pages that hold breakpoint traps, a page that
+// keeps one never loses the flag on the way
+void CPU::Mark_break_pages(void) {
+	uint8_t marked[WATCH_PAGES];
+	memset(marked, 0, sizeof(marked));
+	for (int i = 0; i < Break_count; i++) {
+		marked[Break_address[i] >> WATCH_PAGE_SHIFT] = 1;
+	}
+	for (int page = 0; page < WATCH_PAGES; page++) {
+		if (marked[page]) {
+			__atomic_fetch_or(&Page_flags[page], (uint8_t) PAGE_BREAK,
+			  __ATOMIC_RELAXED);
+		}
+		else {
+			__atomic_fetch_and(&Page_flags[page], (uint8_t) ~PAGE_BREAK,
+			  __ATOMIC_RELAXED);
+		}
+	}
+}
+
+// CPU method to check for breakpoint traps in a memory range
+bool CPU::Has_breakpoints(uint32_t address, uint32_t count) {
+	CPU *p = Primary;
+	for (int i = 0; i < p->Break_count; i++) {
+		if (p->Break_address[i] - address < count) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// CPU method to set a breakpoint by patching the trap into memory
+int CPU::Set_breakpoint(uint32_t address) {
+	if (address >= MEMORY_SIZE) {
+		return -1;
+	}
+	if (Find_breakpoint(address) >= 0) { // already set
+		return 0;
+	}
+	if (Break_count == MAX_BREAKPOINTS) {
+		return -1;
+	}
+	Break_address[Break_count] = address;
+	Break_saved[Break_count] = Memory[address];
+	Break_count++;
+	Memory[address] = BREAKPOINT_TRAP;
+	Page_written(address);
+	Mark_break_pages();
+	return 0;
+}
+
+// CPU method to remove a breakpoint.  Stores to the address went to
+// the saved word, so that is what goes back.
+int CPU::Clear_breakpoint(uint32_t address) {
+	int i = Find_breakpoint(address);
+	if (i < 0) {
+		return -1;
+	}
+	Memory[address] = Break_saved[i];
+	Page_written(address);
+	Break_count--;
+	Break_address[i] = Break_address[Break_count]; // last one fills the hole
+	Break_saved[i] = Break_saved[Break_count];
+	Mark_break_pages();
+	return 0;
+}
+
+// CPU method to list the breakpoints
+int CPU::Get_breakpoints(uint32_t *addresses) {
+	for (int i = 0; i < Break_count; i++) {
+		addresses[i] = Break_address[i];
+	}
+	return Break_count;
+}
+
+// CPU method to show the original words in a copy of memory
+void CPU::Hide_breakpoints(uint32_t address, int32_t *words, uint32_t count) {
+	for (int i = 0; i < Break_count; i++) {
+		uint32_t offset = Break_address[i] - address;
+		if (offset < count && words[offset] == BREAKPOINT_TRAP) {
+			words[offset] = Break_saved[i];
+		}
+	}
+}
+
+// CPU method to put the traps back after count words at address have
+// been written from outside, the new words become the saved ones
+void CPU::Refresh_breakpoints(uint32_t address, uint32_t count) {
+	for (int i = 0; i < Break_count; i++) {
+		if (Break_address[i] - address < count) {
+			Break_saved[i] = Fetch_word(Break_address[i]);
+			__atomic_store_n(&Memory[Break_address[i]], BREAKPOINT_TRAP,
+			  __ATOMIC_RELAXED);
+			Page_written(Break_address[i]);
+		}
+	}
+}
+
+// CPU method to watch a memory word for reads and/or writes
+int CPU::Set_watchpoint(uint32_t address, int type) {
+	if (address >= MEMORY_SIZE || (type & (WATCH_READ | WATCH_WRITE)) == 0) {
+		return -1;
+	}
+	int i = 0;
+	while (i < Watch_count && Watch_address[i] != address) {
+		i++;
+	}
+	if (i == MAX_WATCHPOINTS) {
+		return -1;
+	}
+	if (i == Watch_count) { // new one
+		Watch_count++;
+	}
+	Watch_address[i] = address;
+	Watch_type[i] = type & (WATCH_READ | WATCH_WRITE);
+	Rebuild_watch_pages();
+	return 0;
+}
+
+// CPU method to stop watching a memory word
+int CPU::Clear_watchpoint(uint32_t address) {
+	for (int i = 0; i < Watch_count; i++) {
+		if (Watch_address[i] == address) {
+			Watch_count--;
+			Watch_address[i] = Watch_address[Watch_count];
+			Watch_type[i] = Watch_type[Watch_count];
+			Rebuild_watch_pages();
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// CPU method to list the watchpoints
+int CPU::Get_watchpoints(uint32_t *addresses, int *types) {
+	for (int i = 0; i < Watch_count; i++) {
+		addresses[i] = Watch_address[i];
+		types[i] = Watch_type[i];
+	}
+	return Watch_count;
+}
+
+// CPU method to mark the pages that hold watched words
+void CPU::Rebuild_watch_pages(void) {
+	memset(Watch_pages, 0, sizeof(Watch_pages));
+	for (int i = 0; i < Watch_count; i++) {
+		Watch_pages[Watch_address[i] >> WATCH_PAGE_SHIFT] = 1;
+	}
+}
+
+// CPU method to check a memory range against the watchpoints, only
+// the pages marked as watched get their watchpoints looked at
+bool CPU::Watch_range(uint32_t address, uint32_t count, int type) {
+	if (address >= MEMORY_SIZE || count == 0) {
+		return false;
+	}
+	if (count > MEMORY_SIZE - address) {
+		count = MEMORY_SIZE - address;
+	}
+	CPU *p = Primary; // watchpoints are kept by the primary core
+	uint32_t last = (address + count - 1) >> WATCH_PAGE_SHIFT;
+	for (uint32_t page = address >> WATCH_PAGE_SHIFT; page <= last; page++) {
+		if (p->Watch_pages[page]) {
+			for (int i = 0; i < p->Watch_count; i++) {
+				if ((p->Watch_type[i] & type) && p->Watch_address[i] - address < count) {
+					Watch_hit_address = p->Watch_address[i];
+					Watch_hit_type = type;
+					return true;
+				}
+			}
+			return false; // no need to look at more pages
+		}
+	}
+	return false;
+}
+
+// CPU method to work out which memory an instruction is about to touch
+// and check it against the watchpoints
+bool CPU::Check_watch(int32_t instruction) {
+
+	if ((instruction & 0xF0000000) != 0) { // memory reference
+		int code = (instruction >> 28) & 0x0000000F ;
+		int idx_reg = (instruction >> 24) & 0x0000000F ;
+		uint32_t address = instruction & 0x000FFFFF ;
+		if (idx_reg != 0) {
+			address += Regs[idx_reg] ;
+		}
+		switch (code) {
+			case 1: // load, add and subtract read memory
+			case 3:
+			case 4:
+				return Watch_range(address, 1, WATCH_READ);
+			case 2: // store
+				return Watch_range(address, 1, WATCH_WRITE);
+			case 6: // call pushes the return address
+				return Watch_range(Regs[SP_REGISTER] - 1, 1, WATCH_WRITE);
+			case 7: // atomics read and write
+			case 8:
+				return Watch_range(address, 1, WATCH_READ | WATCH_WRITE);
+		}
+		return false;
+	}
+	if ((instruction & 0xFFFF0000) != 0) { // no memory operands
+		return false;
+	}
+	if ((instruction & 0x0000F000) != 0) { // single register
+		int code = (instruction >> 12) & 0x0000000F ;
+		if (code == 4) { // push
+			return Watch_range(Regs[SP_REGISTER] - 1, 1, WATCH_WRITE);
+		}
+		if (code == 5) { // pop
+			return Watch_range(Regs[SP_REGISTER], 1, WATCH_READ);
+		}
+		return false;
+	}
+	if ((instruction & 0x00000F00) != 0) { // I/O, the block device and channels
+		int code = (instruction >> 8) & 0x0000000F ;
+		uint32_t control = Regs[instruction & 0x0000000F] ;
+		if (code >= 0xB && code <= 0xE && control <= MEMORY_SIZE - 2) {
+			if (Watch_range(control, 2, WATCH_READ | WATCH_WRITE)) {
+				return true;
+			}
+			bool sending = (code == 0xB || code == 0xD) ;
+			return Watch_range(Load_word(control), Load_word(control + 1),
+			  sending ? WATCH_READ : WATCH_WRITE);
+		}
+		if ((code != 4 && code != 5) || control > MEMORY_SIZE - 3) {
+			return false;
+		}
+		if (Watch_range(control, 3, WATCH_READ)) {
+			return true;
+		}
+		uint32_t sectors = Load_word(control + 2) ;
+		uint32_t count = sectors > MEMORY_SIZE / SECTOR_SIZE ?
+		  MEMORY_SIZE : sectors * SECTOR_SIZE ;
+		return Watch_range(Load_word(control + 1), count,
+		  code == 4 ? WATCH_WRITE : WATCH_READ);
+	}
+	if ((instruction & 0x000000F0) == 0x00000020) { // return pops the stack
+		return Watch_range(Regs[SP_REGISTER], 1, WATCH_READ);
+	}
+	return false;
+}
+
+// CPU method to execute an instruction
+int CPU::Execute(int32_t instruction){
+	
+// look for all zero's, halt instruction
+	if ( instruction == 0) { // halt
+		return INSTRUCTION_HALT ;
+	}
+	
+// look for non-zero X7 digit (high order hex digit)
+	 else if ( (instruction & 0xF0000000) != 0 ){ // process non_zero X7
+		return ProcessX7(instruction);
+	}
+// look for non-zero X6 digit 
+	else if ( (instruction & 0x0F000000) != 0 ){ // process non_zero X6
+		return ProcessX6(instruction);	
+	}
+// look for non-zero X5 digit
+	else if ( (instruction & 0x00F00000) != 0) { // process non_zero X5
+		return ProcessX5(instruction);
+	}	
+// look for non-zero X4 digit
+	else if ( (instruction & 0x000F0000) != 0) { // process non-zero X4
+		return ProcessX4(instruction);
+	}
+	
+// look for non-zero X3 digit
+	else if ( (instruction & 0x0000F000) != 0) { // process non-zero X3
+		return ProcessX3(instruction);
+	}
+	
+// look for non-zero X2 digit
+	else if ( (instruction & 0x00000F00) != 0) { // process non-zero X2
+		return ProcessX2(instruction);
+	}	
+	
+// look for non-zero X1 digit
+	else if ( (instruction & 0x000000F0) != 0) { // process non-zero X1
+		return ProcessX1(instruction);
+	}		
+// no match, return bad instruction
+	
+	else return INSTRUCTION_NOT_IMPLEMENTED;
+
+
+
+}
+// CPU method to handle X7 != 0 (Memory reference instructions)
+int CPU::ProcessX7(int32_t instruction) {
+	
+//	printf ("Instruction decoded as X7 %08X instruction \n");
+
+	int code = (instruction >> 28) & 0x0000000F ;// get op code
+//	printf("Hex code X7 is %01X \n",code);
+	
+	int idx_reg = (instruction >> 24) & 0x0000000F ; // get index reg
+//	printf("Index register is %01X \n",idx_reg);
+	
+	int dest_reg = (instruction >> 20) & 0x0000000F ; // get destination
+//	printf("Destination register is %01X \n",dest_reg);
+	
+	int32_t address = instruction & 0x000FFFFF ;// base address from instruction
+//	printf("Base address is %08X \n",address);
+	
+	if (idx_reg != 0) { // compute effective address
+		address = address +  Regs[idx_reg] ;
+//		printf("After index, address is %08X \n",address);
+	}
+
+	// data references must land in memory, branches get caught at the fetch
+	if ((uint32_t) address >= MEMORY_SIZE && code != 5 && code != 6) {
+		return INSTRUCTION_ADDRESS_FAULT ;
+	}
+	
+	// decode the instruction using a switch statement
+	switch (code) {
+		case 1: {  // load register
+			Regs [dest_reg] = Load_word(address) ;
+			break;
+		}
+		case 2: { // store register
+			Store_word(address, Regs [dest_reg]) ;
+			break;
+		}
+		case 3: { // add to register
+			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
+			Regs [dest_reg] += Load_word(address) ;
+			break;
+		}
+		case 4: { // subract from register
+			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!!
+			Regs [dest_reg] -= Load_word(address) ;
+			break;
+		}
+		case 5: { // branch to address
+			Regs [PCR_REGISTER] = address;
+			Branches++ ;
+			Cover(address) ;
+			return 0; // return OK to bypass PCR increment
+			break;
+		
+		}
+		case 6: { // call
+			if ((uint32_t) (Regs [SP_REGISTER] - 1) >= MEMORY_SIZE) { // no stack
+				return INSTRUCTION_ADDRESS_FAULT ;
+			}
+			Regs [PCR_REGISTER]++; // Increment the program counter by 1 
+			Regs [SP_REGISTER]-- ; // decrement the stack pointer
+			Store_word(Regs [SP_REGISTER], Regs [PCR_REGISTER]); // store return
+			Regs [PCR_REGISTER] = address ; // transfer to address
+			Calls++ ;
+			Cover(address) ;
+			return 0; // return OK to bypasss PCR increment
+		}
+		case 7: { // atomic fetch and add, register gets the old value
+			Regs [dest_reg] = __atomic_fetch_add(Word_at(address),
+			  Regs [dest_reg], __ATOMIC_SEQ_CST) ;
+			Code_stored(address) ;
+			break;
+		}
+		case 8: { // atomic compare and swap, skip if swapped
+			int32_t expected = Regs [dest_reg] ; // new value in next register
+			bool swapped = __atomic_compare_exchange_n(Word_at(address),
+			  &expected, Regs [(dest_reg + 1) & 0x0000000F], false,
+			  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) ;
+			Regs [dest_reg] = expected ; // old memory contents
+			if (swapped) {
+				Code_stored(address) ;
+				Stores++ ;
+				Regs [PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs [PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		default: { // instruction not implemented
+			return INSTRUCTION_INVALID ;
+		}
+
+	}
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}
+
+// CPU method to handle X6 != 0 (Immediate instructions)
+int CPU::ProcessX6(int32_t instruction) {
+
+
+//	printf ("Instruction decoded as X6 %08X instruction \n",instruction);
+
+	int code = (instruction >> 24) & 0x0000000F ;// get op code
+//	printf("Hex code X6 is %01X \n",code);
+
+	int dest_reg = (instruction >> 20) & 0x0000000F ; // get destination
+//	printf("Destination register is %08X \n",dest_reg);
+	
+	int32_t value = instruction & 0x000FFFFF ;// immediate value from instruction
+
+	int32_t signed_value = value ; // first assume non negative
+	if ( (value & 0x0008000) != 0) { // short number is negative
+		signed_value = signed_value | 0xFFF ; // extend sign
+	}
+//	printf("Value is %08X \n",value);
+//	printf("Value with sign is %08X \n",signed_value) ;
+	
+	
+	// decode the instruction using a switch statement
+	switch (code) {
+		case 1: {  // load immediate
+			Regs [dest_reg] = value ;
+			break;
+		}
+		case 2: { // load immediate arithmetic
+			Regs [dest_reg] = signed_value ;
+			break;
+		}
+		case 3: { // add  immediate to register
+			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
+			Regs [dest_reg] += signed_value ;
+			break;
+		}
+		case 4: { // subract immediate from register
+			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!!
+			Regs [dest_reg] -= signed_value ;
+			break;
+		}
+		case 5: { // OR immediate
+			Regs [dest_reg] = Regs [dest_reg] | value;
+			return 0; // return OK to bypass PCR increment
+			break;
+		
+		}
+		case 6: { // AND immediate
+			Regs [dest_reg] = Regs [dest_reg] & value ;
+			break;
+		}
+		case 7: { // XOR immediate
+			Regs [dest_reg] = Regs [dest_reg] ^ value;	
+			break;
+		}		
+		default: { // instruction not implemented
+			return INSTRUCTION_INVALID ;
+		}
+
+	}
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}
+
+// CPU method to handle X5 != 0 (Shift instructions)
+int CPU::ProcessX5(int32_t instruction) {
+
+
+//	printf ("Instruction decoded as X5 type instruction is %08X \n",instruction);
+
+	int code = (instruction >> 20) & 0x0000000F ;// get op code
+//	printf("Hex code X5 is %01X \n",code);
+
+	int dest_reg = (instruction >> 16) & 0x0000000F ; // get destination
+//	printf("Destination register is 08X \n",dest_reg);
+	
+	int shift_count = instruction & 0x0000001F ;// shift count
+//	printf("Shift count is %08X \n",shift_count);
+
+	
+	// decode the instruction using a switch statement
+	switch (code) { 
+		case 1: {  // Shift left logical
+			Regs[dest_reg] = Regs[dest_reg] << shift_count ;
+			break;
+		}
+		case 2: { // Shift right logical
+			Regs[dest_reg] = Regs[dest_reg] >> shift_count ;			
+			break;
+		}
+		case 3: { // Shift left arithmetic
+
+			int cnt = 0 ; // counts how many we have done
+			int32_t initial_sign = Regs[dest_reg] & 0x80000000 ;
+			
+			while (cnt < shift_count) {
+
+				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
+				Regs[dest_reg] = Regs[dest_reg] << 1 ; // do the shift
+				//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
+			
+				cnt++; // increment counter ;
+			}
+			break;
+		}
+		
+		case 4: { // Shift right arithmetic
+			int cnt = 0 ; // counts how many we have done
+			
+			while (cnt < shift_count) {
+
+				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
+				Regs[dest_reg] = Regs[dest_reg] >>  1 ; // do the shift
+				if (sign == 0x80000000) { // if number was negative
+					Regs[dest_reg] = Regs[dest_reg] | 0x80000000; //extend sign
+				}
+				cnt++; // increment counter ;
+			}			
+
+			break;
+		}
+		case 5: { // Shift left circular
+			int cnt = 0 ; // counts how many we have done
+			while (cnt < shift_count) {
+
+				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
+				Regs[dest_reg] = Regs[dest_reg] << 1 ; // do the shift
+				if (sign == 0x80000000) { // set low bit if sign set
+					Regs[dest_reg] = Regs[dest_reg] | 0x000000001 ;
+				}
+				cnt++; // increment counter ;
+			}	
+				
+					
+			break;
+		
+		}
+		case 6: { // Shift right circular
+			int cnt = 0 ; // counts how many we have done
+			while (cnt < shift_count) {
+
+				int lsb = Regs[dest_reg] & 0x00000001 ;// isolate lsb
+				Regs[dest_reg] = Regs[dest_reg] >> 1 ; // do the shift
+				if (lsb == 0x00000001) { // set sign bit if lsb set
+					Regs[dest_reg] = Regs[dest_reg] | 0x80000000 ;
+				}
+				
+				cnt++; // increment counter ;
+			}	
+			break;
+		}
+	
+		default: { // instruction not implemented
+			return INSTRUCTION_INVALID ;
+		}
+
+	}
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}
+
+// CPU method to handle X4 != 0 (Register to register instructions)
+int CPU::ProcessX4(int32_t instruction) {
+
+//	printf ("Instruction decoded as X4 type instruction is %08X \n",instruction);
+
+	int code = (instruction >> 16) & 0x0000000F ;// get op code
+//	printf("Hex code X4 is %01X \n",code);
+
+	int dest_reg = (instruction >> 8) & 0x0000000F ; // get destination
+//	printf("Destination register is 08X \n",dest_reg);
+	
+	int src_reg = instruction  & 0x0000000F ; // get source register
+//	printf("Destination register is 08X \n",dest_reg);	
+	
+	// decode the instruction using a switch statement
+	switch (code) { 
+
+		case 1: {  // Copy register
+			Regs[dest_reg] = Regs[src_reg] ; // do the copy
+			break ;
+		}
+		
+		case 2: { // Add register
+			Regs[dest_reg] += Regs[src_reg] ; // do the add
+			//!!!!!!!!!!!!!!!!! need overflow check !!!!!!!!!!!!
+			break; 
+		}
+		
+		case 3: { // Subtract register
+			Regs[dest_reg] -= Regs[src_reg] ; // do the subtract
+			//!!!!!!!!!!!!!!!!! need overflow check !!!!!!!!!!!!
+			break;
+		}
+		
+		case 4: { // 'OR' registers
+			Regs[dest_reg] = Regs[src_reg] | Regs[dest_reg] ;
+			break;
+		}
+		
+		case 5: { // 'AND' registers
+			Regs[dest_reg] = Regs[src_reg] & Regs[dest_reg] ;
+			break;			
+		}
+		
+		case 6: { // 'XOR' registers
+			Regs[dest_reg] = Regs[src_reg] ^ Regs[dest_reg] ;
+			break;
+		}
+		
+		case 7: { // skip greater
+			if (Regs[src_reg] > Regs[dest_reg]) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		
+		case 8: { // skip greater or equal
+			if (Regs[src_reg] >= Regs[dest_reg]) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}			
+			break;
+		}	
+		
+		case 9: { // skip equal
+			if (Regs[src_reg] == Regs[dest_reg]) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		
+		case 0xA: { //  skip less than or equal
+			if (Regs[src_reg] <= Regs[dest_reg]) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		
+		case 0xB: { // skip less than
+			if (Regs[src_reg] < Regs[dest_reg]) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		
+		case 0xC: { // skip on overflow
+			if (Regs[STATUS_REGISTER] & OVERFLOW_BIT) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break;
+		}
+		
+
+		case 0xD: { // skip no overflow
+
+			
+			break;
+		}
+		
+		default: { // instruction not implemented
+			return INSTRUCTION_INVALID ;
+		}
+
+	}
+			
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}	
+
+// CPU method to handle X3 != 0 (Single Register Instructions)
+int CPU::ProcessX3(int32_t instruction) {
+//	printf ("Instruction decoded as X3 type instruction is %08X \n",instruction);
+
+	int code = (instruction >> 12) & 0x0000000F ;// get op code
+//	printf("Hex code X2 is %01X \n",code);
+	
+	int reg = instruction & 0x0000000F ; // get register
+//  printf("Register is %08X \n",reg);
+	
+	// decode the instruction using a switch statement
+	switch (code) { 
+
+		case 1: {  // clear register
+			Regs[reg] = 0 ;
+			break;
+		}
+		
+		case 2: { // invert register
+			Regs[reg] ^ 0xFFFFFFFF ;
+			break;
+		}
+		
+		case 3: { // complement register
+			if (Regs[reg] == 0x80000000) { // check for overflow
+				Regs[0] = Regs[0] | 0x00000001 ; // set overflow bit
+				Regs[0] = 0x7FFFFFF ; // set to max positive allowed
+				break;
+			}
+			else {
+				Regs[0] = Regs[0] & 0xFFFFFFFE ; // clear overflow
+			}
+			
+			Regs[reg] = -Regs[reg]; // no overflow, normal complement
+			break;
+		}
+		
+		case 4: { // Push register
+			if ((uint32_t) (Regs[SP_REGISTER] - 1) >= MEMORY_SIZE) { // no stack
+				return INSTRUCTION_ADDRESS_FAULT ;
+			}
+			Regs[SP_REGISTER]-- ; // decrement stack pointer
+			Store_word(Regs[SP_REGISTER], Regs[reg]) ; // push register
+			break;
+		}
+		
+		case 5: { // Pop register
+			if ((uint32_t) Regs[SP_REGISTER] >= MEMORY_SIZE) { // no stack
+				return INSTRUCTION_ADDRESS_FAULT ;
+			}
+			Regs[reg] = Load_word(Regs[SP_REGISTER]) ; // pop register
+			Regs[SP_REGISTER]++ ; // increment stack pointer
+			break;
+		}
+		
+		case 6: { // Read performance counter, register selects which
+			int32_t select = Regs[reg] ;
+			uint64_t value ;
+			Account_to(Regs[PCR_REGISTER]) ; // count what ran before us
+			switch (select & COUNTER_SELECT) {
+				case COUNTER_INSTRUCTIONS: value = Instructions ; break;
+				case COUNTER_BRANCHES: value = Branches ; break;
+				case COUNTER_CALLS: value = Calls ; break;
+				case COUNTER_LOADS: value = Loads ; break;
+				case COUNTER_STORES: value = Stores ; break;
+				case COUNTER_IO: value = Io_operations ; break;
+				default: value = 0 ; break;
+			}
+			if (select & COUNTER_HIGH) { // upper half wanted
+				value >>= 32 ;
+			}
+			Regs[reg] = (int32_t) value ;
+			break;
+		}
+		
+		case 7: { // Load core ID
+			Regs[reg] = Core_id ;
+			break;
+		}
+		
+		default: { // invalid instruction
+			return INSTRUCTION_INVALID ;
+		}
+		
+	} // end of switch decode	
+	
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}
+	
+// CPU method to handle X2 != 0 (I/O instructions)
+int CPU::ProcessX2(int32_t instruction) {	
+	
+	
+//	printf ("Instruction decoded as X2 type instruction is %08X \n",instruction);
+
+	int code = (instruction >> 8) & 0x0000000F ;// get op code
+//	printf("Hex code X2 is %01X \n",code);
+	
+	int ioreg = instruction & 0x0000000F ; // get register
+//  printf("IO register is %08X \n",ioreg);
+
+	Account_to(Regs[PCR_REGISTER]) ; // counters are up to date for I/O hooks
+	
+	// decode the instruction using a switch statement
+	switch (code) { 
+
+		case 1: {  // Write character
+			int c = Regs[ioreg] & 0xFF ; // isolate low byte
+			Writer(Io_context, c); // output the character
+			Chars_out++ ;
+			break ;
+		}	
+		
+		case 2: { // Read character
+			int c ;
+			c = Reader(Io_context) ; // get a character
+			Chars_in++ ;
+			Regs[ioreg] = (Regs[ioreg] & 0xFFFFFF00) | (c & 0xFF) ;
+			break ;			
+		}
+		
+		case 3: { // Write register contents line
+			char line[40] ;
+			int length = snprintf(line,sizeof(line),"Reg %1x = %08x \n",ioreg,Regs[ioreg]) ;
+			for (int i = 0; i < length; i++) {
+				Writer(Io_context, line[i]) ;
+			}
+			Chars_out += length ;
+			break ;
+		}
+
+		case 4:   // Block read, register points at the control block
+		case 5: { // Block write, status comes back in the register
+			uint32_t control = Regs[ioreg] ;
+			if (control > MEMORY_SIZE - 3) { // control block must fit
+				Regs[ioreg] = BLOCK_BAD_ADDRESS ;
+			}
+			else {
+				int32_t *block = &Memory[control] ;
+				int32_t count = Load_word(control + 2) ; // sectors requested
+				Regs[ioreg] = Primary->Disk.Transfer(Memory, block, code == 5, Primary) ;
+				if (Regs[ioreg] == BLOCK_OK) {
+					if (code == 5) {
+						Sectors_written += count ;
+					}
+					else {
+						Sectors_read += count ;
+					}
+				}
+			}
+			break ;
+		}
+
+		case 6: { // Block device size in sectors, zero if none attached
+			Regs[ioreg] = Primary->Disk.Get_sectors() ;
+			break ;
+		}
+
+		case 7:   // Channel send word, waits while the channel is full
+		case 8:   // Channel receive word, waits while it is empty
+		case 9:   // Channel send word if there is room, skip if sent
+		case 0xA: // Channel receive word if there is one, skip if received
+		case 0xB: // Channel block send, receiver copies from our memory
+		case 0xC: // Channel block receive, waits for all of it
+		case 0xD: // Channel block send of what fits, skip when finished
+		case 0xE: { // Channel block receive of what is there, skip when finished
+			int advance ;
+			int status = Channel_io(code, (instruction >> 4) & 0x0000000F, ioreg, &advance) ;
+			if (status != 0) {
+				return status ;
+			}
+			if (advance == 0) { // the run loop yields and runs us again
+				return INSTRUCTION_WAIT ;
+			}
+			if (advance == 2) {
+				Regs[PCR_REGISTER]++ ;
+				Branches++ ;
+				Cover(Regs[PCR_REGISTER] + 1) ;
+			}
+			break ;
+		}
+		
+		default: { // instruction not implemented
+			return INSTRUCTION_INVALID ;
+		}
+
+	} // end of switch decode
+			
+	Io_operations++ ;
+	Regs[PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}			
+
+// CPU method for the channel instructions.  advance comes back 0 if the
+// instruction has to wait and run again, 1 when done, 2 to skip.  Block
+// transfers take {address, count} at the register's address and move
+// it along as words go; the register gets a CHANNEL_* status once the
+// transfer is finished.
+int CPU::Channel_io(int code, int port, int ioreg, int *advance) {
+	bool sending = (code == 7 || code == 9 || code == 0xB || code == 0xD) ;
+	Channel *channel = Primary->Ports[port] ;
+	if (channel == NULL ||
+	  Primary->Port_end[port] != (sending ? CHANNEL_SEND : CHANNEL_RECEIVE)) {
+		return INSTRUCTION_INVALID ; // no such device
+	}
+	// check before moving anything, words sent just before closing count
+	bool closed = channel->Closed(sending ? CHANNEL_RECEIVE : CHANNEL_SEND) ;
+	bool poll = (code >= 9 && code != 0xB && code != 0xC) ;
+	*advance = 1 ;
+
+	if (code <= 0xA) { // single words
+		bool moved ;
+		if (sending) { // nobody listening, the word is dropped
+			moved = closed || channel->Send(Regs[ioreg]) ;
+		}
+		else {
+			int32_t word ;
+			moved = channel->Receive(&word, 1) == 1 ;
+			if (moved) {
+				Regs[ioreg] = word ;
+			}
+			else if (closed) {
+				Regs[ioreg] = CHANNEL_END ;
+			}
+		}
+		if (moved && poll) {
+			*advance = 2 ;
+		}
+		else if (!moved && !poll && !closed) {
+			*advance = 0 ;
+		}
+		return 0 ;
+	}
+
+	uint32_t control = Regs[ioreg] ;
+	if (control > MEMORY_SIZE - 2) { // control block must fit
+		Regs[ioreg] = CHANNEL_BAD_ADDRESS ;
+		return 0 ;
+	}
+	uint32_t address = Load_word(control) ;
+	uint32_t count = Load_word(control + 1) ;
+	if (address > MEMORY_SIZE || count > MEMORY_SIZE - address) {
+		Regs[ioreg] = CHANNEL_BAD_ADDRESS ;
+		return 0 ;
+	}
+
+	// words sent must not carry breakpoint traps, those go from a copy
+	uint32_t moved = 0 ;
+	if (code == 0xB) { // all or nothing, the receiver does the copy
+		int32_t **staged = &Primary->Staged[port] ;
+		if (*staged == NULL && Has_breakpoints(address, count) &&
+		  (*staged = (int32_t *) malloc(count * sizeof(int32_t))) != NULL) {
+			Copy_words(*staged, &Memory[address], count) ;
+			Primary->Hide_breakpoints(address, *staged, count) ;
+		}
+		const int32_t *words = *staged != NULL ? *staged : &Memory[address] ;
+		moved = channel->Send_direct(words, count) ? count : 0 ;
+	}
+	else if (code == 0xD && !closed) {
+		if (Has_breakpoints(address, count)) { // a piece at a time
+			int32_t piece[SECTOR_SIZE] ;
+			uint32_t words = count < SECTOR_SIZE ? count : SECTOR_SIZE ;
+			Copy_words(piece, &Memory[address], words) ;
+			Primary->Hide_breakpoints(address, piece, words) ;
+			moved = channel->Send_some(piece, words) ;
+		}
+		else {
+			moved = channel->Send_some(&Memory[address], count) ;
+		}
+	}
+	else if (code != 0xD) { // what was sent before closing still comes through
+		moved = channel->Receive(&Memory[address], count) ;
+		Primary->Refresh_breakpoints(address, moved) ;
+		Code_written(address, moved) ;
+	}
+	Store_word(control, address + moved) ;
+	Store_word(control + 1, count - moved) ;
+
+	if (count != moved && !(closed && moved == 0)) { // not finished
+		*advance = poll ? 1 : 0 ;
+		return 0 ;
+	}
+	if (code == 0xB) { // done with any copy
+		free(Primary->Staged[port]) ;
+		Primary->Staged[port] = NULL ;
+	}
+	Regs[ioreg] = (count == moved) ? CHANNEL_OK : CHANNEL_CLOSED ;
+	if (poll) {
+		*advance = 2 ;
+	}
+	return 0 ;
+}
+
+// CPU method to handle X1 != 0 (Misc instructions)
+int CPU::ProcessX1(int32_t instruction) {	
+
+
+//	printf ("Instruction decoded as X1 type instruction is %08X \n",instruction);
+
+	int code = (instruction >> 4) & 0x0000000F ;// get op code
+//	printf("Hex code X1 is %01X \n",code);
+
+	// decode the instruction using a switch statement
+	switch (code) { 
+
+		case 1: {  // No op
+
+			break ;
+		}	
+		
+		case 2: { // call return
+
+			if ((uint32_t) Regs[SP_REGISTER] >= MEMORY_SIZE) { // no stack
+				return INSTRUCTION_ADDRESS_FAULT ;
+			}
+			Regs[PCR_REGISTER] = Load_word(Regs[SP_REGISTER])  ; // go back via stack
+			Regs[SP_REGISTER]++ ; // bump the stack
+			Branches++ ;
+			Cover(Regs[PCR_REGISTER]) ;
+			return 0 ; // bypass PCR increment
+		}
+
+		case 3: { // memory fence
+			__atomic_thread_fence(__ATOMIC_SEQ_CST) ;
+			break ;
+		}
+
+		case 0xF: { // breakpoint trap, invalid unless one of ours is here
+			if (Find_breakpoint(Regs[PCR_REGISTER]) >= 0) {
+				return INSTRUCTION_BREAKPOINT ;
+			}
+			return INSTRUCTION_INVALID ;
+		}
+	
+		default: {
+			return INSTRUCTION_INVALID ;
+		}
+	} // end of decode switch
+
+	Regs [PCR_REGISTER]++ ; // increment the program counter			
+	return 0;
+}	
+// CPU method for tests, called by console with 'test' command
+
+int CPU::Test(void) { // test code goes here, called by 'test' from console
+	printf("Test routine entered \n") ;
+	return 0 ;
+}
+
+
+
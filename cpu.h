@@ -0,0 +1,294 @@
+/* cpu.h - CPU and device classes for the emulated hypothetical computer.
+ * Shared by the library (cpu.cpp, libmachine.cpp), outside code should
+ * use the C interface in libmachine.h instead.
+ *
+ * Memory model: in SMP mode the cores are host threads sharing Memory.
+ * Every guest access to a word, fetches included, is a relaxed atomic
+ * (Fetch_word, Load_word and Store_word), so a word is never torn but accesses to
+ * different words may be seen in any order by another core.  Guests
+ * that need ordering use the fence instruction (X1 = 3) or the atomic
+ * fetch-add and compare-and-swap (X7 = 7 and 8), which are sequentially
+ * consistent.  Channel copies use Copy_words from host.h, and so do
+ * block device transfers unless no other thread can see Memory (one
+ * core, no channels connected), when they are a plain memcpy.*/
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <limits.h>
+#include "channel.h"
+
+/* Global constants */
+#define NUM_REGISTERS 16
+#define PCR_REGISTER 15
+#define SP_REGISTER 14
+#define STATUS_REGISTER 0
+#define OVERFLOW_BIT 0x00000001
+#define MEMORY_SIZE 0X10000 // Set to 32k for now,can be expanded to 20 bits
+
+#define INSTRUCTION_INVALID 1 // return code for invalid instruction
+#define INSTRUCTION_NOT_IMPLEMENTED 2  // defined but not implemented yet
+#define INSTRUCTION_HALT 3 // return code for halt instruction encountered
+#define INSTRUCTION_ADDRESS_FAULT 4 // program counter or data address outside memory
+#define INSTRUCTION_BREAKPOINT 5 // stopped on a breakpoint
+#define INSTRUCTION_WATCHPOINT 6 // watched memory was accessed
+#define INSTRUCTION_WAIT 8 // channel not ready, nothing retired; Run and Step retry it
+
+#define MAX_CORES 16 // cores sharing one memory in SMP mode
+#define COVERAGE_SIZE 0x4000 // bytes in a fuzzing edge coverage map
+
+#define BREAKPOINT_TRAP 0x000000F0 // reserved X1 = 0xF, patched in for breakpoints
+#define MAX_BREAKPOINTS 32
+#define MAX_WATCHPOINTS 32
+#define WATCH_READ 1 // watchpoint fires on reads
+#define WATCH_WRITE 2 // watchpoint fires on writes
+#define WATCH_PAGE_SHIFT 8 // watched pages are 256 words
+#define WATCH_PAGES (MEMORY_SIZE >> WATCH_PAGE_SHIFT)
+#define PAGE_BREAK 0x01 // Page_flags bit, the page holds a breakpoint trap
+#define PAGE_CODE 0x02 // Page_flags bit, the page holds summarized code
+#define PAGE_CLEAN 0x04 // Page_flags bit, the page still matches the restored copy
+
+// Performance counters read by X3 = 6, selected by the register contents
+#define COUNTER_INSTRUCTIONS 0 // instructions retired
+#define COUNTER_BRANCHES 1 // taken branches, skips and returns
+#define COUNTER_CALLS 2 // calls
+#define COUNTER_LOADS 3 // memory words read by instructions
+#define COUNTER_STORES 4 // memory words written by instructions
+#define COUNTER_IO 5 // I/O instructions
+#define COUNTER_SELECT 0x0000000F // counter number bits of the selector
+#define COUNTER_HIGH 0x00000010 // selector bit for the upper 32 bits
+#define MAX_SUMMARY 255 // longest basic block a summary is kept for
+
+#define SECTOR_SIZE 128 // words per block device sector
+#define BLOCK_OK 0 // block transfer completed
+#define BLOCK_NO_DEVICE 1 // no host file attached
+#define BLOCK_BAD_SECTOR 2 // sector range outside the device
+#define BLOCK_BAD_ADDRESS 3 // control block or buffer outside memory
+
+#define MAX_PORTS 16 // channel ports, X2 = 7 to E take the port in X1
+#define CHANNEL_OK 0 // block transfer completed
+#define CHANNEL_CLOSED 1 // the other end finished before it completed
+#define CHANNEL_BAD_ADDRESS 2 // control block or buffer outside memory
+#define CHANNEL_END -1 // received once the sender has closed and the ring is empty
+
+class CostModel; // cost.h
+class CPU;
+
+// What a straight run of instructions from one address does, kept so
+// the counters can be added up a basic block at a time
+struct Block_summary {
+	uint32_t generation; // Code_generation when made, stale once it moves
+	uint8_t length; // instructions
+	uint8_t loads; // memory words they read
+	uint8_t stores; // and write
+};
+
+// Console I/O hooks, the default ones use stdio
+typedef int (*Read_hook)(void *context); // returns a character
+typedef void (*Write_hook)(void *context, int c); // outputs a character
+
+//********************************************************************
+// Class to implement the block storage device.  The host file is
+// mapped into our address space so sector transfers are a straight
+// copy between the mapping and Memory, no per-word work at all.
+//********************************************************************
+class BlockDevice
+{
+
+	public:
+		BlockDevice();	// Constructor
+		~BlockDevice();	// Destructor, detaches any file
+		int Attach(const char *path, int32_t sectors); // map a host file
+		void Detach(); // flush and unmap the host file
+		int Transfer(int32_t *memory, int32_t *control, bool write,
+		  CPU *owner); // do a sector transfer
+		int32_t Get_sectors() { return Sectors; } // device size in sectors
+		const char *Get_path() { return Path; } // attached file name
+
+	private:
+
+		int32_t *Map;	// mapped host file, NULL if nothing attached
+		int32_t Sectors;	// number of whole sectors in the file
+		char Path[PATH_MAX];	// name of the attached file
+};
+
+//********************************************************************
+// Class to implement the CPU
+//********************************************************************
+class CPU
+{
+
+	public:
+		CPU(CPU *primary = NULL);	// Constructor, secondary cores share a primary's memory
+		~CPU();	// Destructor, releases memory
+		int Step(); // Step the CPU single instruction step
+		int Run(uint64_t limit); // Run the CPU, limit of 0 runs until stopped
+		int Test() ; // Run whatever code is in the test section
+		int32_t Get_register_value (int register_number) ; // get value
+		int Store_value_in_register(int register_number, int32_t value) ; // store value
+		void Set_io(Read_hook reader, Write_hook writer, void *context); // console I/O
+		void Reset_counters(); // zero the statistics
+		void Snapshot(int32_t *memory, int32_t *regs); // copy, breakpoints hidden
+		void Restore(const int32_t *memory, const int32_t *regs); // put a copy back, dirty pages only
+		int Set_breakpoint(uint32_t address); // patch in a breakpoint trap
+		int Clear_breakpoint(uint32_t address); // restore the original word
+		int Get_breakpoints(uint32_t *addresses); // list, returns count
+		bool Is_breakpoint(uint32_t address) { return Find_breakpoint(address) >= 0; }
+		void Hide_breakpoints(uint32_t address, int32_t *words, uint32_t count);
+		void Refresh_breakpoints(uint32_t address, uint32_t count);
+		void Code_written(uint32_t address, uint32_t count); // after outside writes
+		int Connect(int port, Channel *channel, int end); // attach a channel end
+		void Disconnect(int port); // close our end and forget it
+		void Close_ports(); // close every end, on halting
+		void Copy_memory(int32_t *to, const int32_t *from, size_t count); // for devices
+		int Set_watchpoint(uint32_t address, int type); // watch reads and/or writes
+		int Clear_watchpoint(uint32_t address); // stop watching a word
+		int Get_watchpoints(uint32_t *addresses, int *types); // list, returns count
+		BlockDevice Disk; // block storage device, the primary's is used
+		int32_t *Memory; // main memory, MEMORY_SIZE words, see the memory model above
+		int32_t Core_id; // read by the guest with X3 = 7
+		uint8_t *Coverage; // edge coverage map when fuzzing, else NULL
+		uint16_t *Touched; // map entries hit first this run, COVERAGE_SIZE of them
+		uint32_t Touched_count; // COVERAGE_SIZE once the list is full
+		uint32_t Prev_location; // hashed destination of the last edge
+		CostModel *Timing; // cycle cost model when estimating, else NULL
+
+		// Counters, brought up to date a basic block at a time
+		uint64_t Instructions; // instructions retired
+		uint64_t Branches; // taken branches, skips and returns
+		uint64_t Calls; // calls
+		uint64_t Loads; // memory words read by instructions
+		uint64_t Stores; // memory words written by instructions
+		uint64_t Io_operations; // I/O instructions
+		uint64_t Chars_in; // characters read from the console
+		uint64_t Chars_out; // characters written to the console
+		uint64_t Sectors_read; // block device sectors read into memory
+		uint64_t Sectors_written; // block device sectors written from memory
+		uint32_t Watch_hit_address; // word that stopped the last run
+		int Watch_hit_type; // WATCH_READ or WATCH_WRITE
+
+	private:
+
+		int32_t Regs[NUM_REGISTERS];
+		CPU *Primary; // core owning memory, devices and breakpoints, may be this
+		int Cores; // cores sharing the primary's memory, kept by the primary
+		Read_hook Reader; // console input
+		Write_hook Writer; // console output
+		void *Io_context; // passed back to the I/O hooks
+
+		uint32_t Break_address[MAX_BREAKPOINTS]; // where the traps are
+		int32_t Break_saved[MAX_BREAKPOINTS]; // words the traps replaced
+		int Break_count;
+		uint32_t Watch_address[MAX_WATCHPOINTS]; // watched words
+		int Watch_type[MAX_WATCHPOINTS]; // WATCH_READ and/or WATCH_WRITE
+		int Watch_count; // the plain Run loop is used when this is zero
+		uint8_t Watch_pages[WATCH_PAGES]; // pages holding watched words
+		uint8_t Page_flags[WATCH_PAGES]; // PAGE_ bits, stores to flagged pages go slow
+		Channel *Ports[MAX_PORTS]; // connected channels, NULL if none
+		int Port_end[MAX_PORTS]; // CHANNEL_SEND or CHANNEL_RECEIVE
+		int32_t *Staged[MAX_PORTS]; // copy posted by a block send, if it held traps
+		uint32_t Block_start; // first instruction not yet counted
+		Block_summary *Blocks; // summaries by start address, NULL if no room
+		uint32_t Code_generation; // bumped when summarized code is written
+		uint32_t Code_map[MEMORY_SIZE / 32]; // summarized code words
+		const int32_t *Restored; // copy the PAGE_CLEAN pages match, NULL if none
+
+		// Guest accesses to memory, relaxed atomics as the cores share it.
+		// Fetches see breakpoint traps, loads and stores go to the words
+		// the traps replaced so the program never notices them.
+		inline int32_t Fetch_word(uint32_t address) {
+			return __atomic_load_n(&Memory[address], __ATOMIC_RELAXED);
+		}
+		inline int32_t Load_word(uint32_t address) {
+			int32_t value = __atomic_load_n(&Memory[address], __ATOMIC_RELAXED);
+			if (value == BREAKPOINT_TRAP) {
+				value = __atomic_load_n(Word_at(address), __ATOMIC_RELAXED);
+			}
+			return value;
+		}
+		inline void Store_word(uint32_t address, int32_t value) {
+			if (Flags_of(address) != 0) {
+				Store_flagged(address, value);
+				return;
+			}
+			__atomic_store_n(&Memory[address], value, __ATOMIC_RELAXED);
+		}
+		// Page_flags and Code_map are shared by the cores, so they are
+		// read and changed with atomics too
+		inline uint8_t Flags_of(uint32_t address) {
+			return __atomic_load_n(&Primary->Page_flags[address >> WATCH_PAGE_SHIFT],
+			  __ATOMIC_RELAXED);
+		}
+		inline bool Is_code(uint32_t address) {
+			return (__atomic_load_n(&Primary->Code_map[address >> 5],
+			  __ATOMIC_RELAXED) & (1u << (address & 31))) != 0;
+		}
+		int32_t *Word_at(uint32_t address); // guest's word, maybe a saved one
+		void Store_flagged(uint32_t address, int32_t value);
+		void Code_stored(uint32_t address); // summaries may be stale
+		inline void Page_written(uint32_t address) { // no longer clean
+			if (Flags_of(address) & PAGE_CLEAN) {
+				__atomic_fetch_and(&Primary->Page_flags[address >> WATCH_PAGE_SHIFT],
+				  (uint8_t) ~PAGE_CLEAN, __ATOMIC_RELAXED);
+			}
+		}
+		// Count the instructions from Block_start up to end.  The run
+		// loops call End_block when the PC does not just go on to the
+		// next word, the rest is found from a summary of the block.
+		inline void Account_to(uint32_t end) {
+			uint32_t length = end - Block_start;
+			if (end > Block_start) {
+				Instructions += length;
+				Block_summary *block = Blocks != NULL ? &Blocks[Block_start] : NULL;
+				if (block != NULL && block->length == length &&
+				  block->generation == __atomic_load_n(&Primary->Code_generation,
+				  __ATOMIC_RELAXED)) {
+					Loads += block->loads;
+					Stores += block->stores;
+				}
+				else {
+					Summarize(Block_start, length);
+				}
+			}
+			Block_start = end;
+		}
+		inline void End_block(uint32_t at, uint32_t next) {
+			Account_to(at + 1);
+			Block_start = next;
+		}
+		void Summarize(uint32_t start, uint32_t length);
+		void Forget_code(); // all summaries go stale
+		// Note a control transfer in the coverage map, AFL style edges.
+		// Entries hit for the first time are listed so the fuzzer only
+		// has to look at those.
+		inline void Cover(uint32_t to) {
+			if (Coverage != NULL) {
+				uint32_t location = (to * 0x9E3779B1u) >> 18; // 14 bit hash
+				uint32_t edge = (location ^ Prev_location) & (COVERAGE_SIZE - 1);
+				if (++Coverage[edge] == 1 && Touched_count < COVERAGE_SIZE) {
+					Touched[Touched_count++] = edge;
+				}
+				Prev_location = location >> 1;
+			}
+		}
+		int Find_breakpoint(uint32_t address); // index or -1
+		int Execute_at(uint32_t address); // execute, stepping over a breakpoint
+		int Run_watched(uint64_t limit); // Run with watchpoints or timing
+		bool Check_watch(int32_t instruction); // watched access coming?
+		bool Watch_range(uint32_t address, uint32_t count, int type);
+		void Rebuild_watch_pages();
+		void Mark_break_pages();
+		bool Has_breakpoints(uint32_t address, uint32_t count);
+		int Channel_io(int code, int port, int ioreg, int *advance);
+		int Execute  (int32_t instruction); // Execute an instruction
+		int ProcessX7(int32_t instruction); // Process X7 non-zero instructions
+		int ProcessX6(int32_t instruction); // Process X6 non-zero instructions
+		int ProcessX5(int32_t instruction); // Process X5 non-zero instructions
+		int ProcessX4(int32_t instruction); // Process X4 non-zero instructions
+		int ProcessX3(int32_t instruction); // Process X3 non-zero instructions
+		int ProcessX2(int32_t instruction); // Process X2 non-zero instructions
+		int ProcessX1(int32_t instruction); // Process X1 non-zero instructions
+};
+
+#endif
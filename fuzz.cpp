@@ -0,0 +1,338 @@
+/* fuzz.cpp - coverage guided fuzzing of guest programs.
+ * Each worker thread has its own CPU and memory.  Before every run the
+ * worker copies back the pages of the snapshot the last run wrote
+ * instead of building a new CPU, feeds a mutated input through the read
+ * character hook and keeps the input if the edge coverage map shows
+ * something new.  Only the map entries the run touched are looked at.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <new>
+#include "fuzz.h"
+#include "host.h"
+
+#define MAX_FUZZ_WORKERS 64
+#define MAX_CORPUS 4096 // inputs kept for mutating
+
+// An input kept in the corpus, never changed once added
+struct Fuzz_input {
+	size_t length;
+	uint8_t data[MACHINE_FUZZ_MAX_INPUT];
+};
+
+// State shared by all the workers, lock protects everything but the
+// snapshot (read only) and the counters updated with atomics
+struct Fuzz_shared {
+	const machine_fuzz_options_t *options;
+	machine_fuzz_result_t *result;
+	size_t max_length;
+	int32_t memory[MEMORY_SIZE]; // snapshot to start each run from
+	int32_t regs[NUM_REGISTERS];
+	pthread_mutex_t lock;
+	uint8_t virgin[COVERAGE_SIZE]; // hit count buckets seen so far
+	Fuzz_input *corpus[MAX_CORPUS];
+	size_t corpus_count; // published with a release store
+	uint64_t claimed; // runs handed out
+	uint64_t done; // runs finished
+};
+
+// One worker, with its own machine
+struct Fuzz_worker {
+	Fuzz_shared *shared;
+	pthread_t thread;
+	uint64_t random; // xorshift state
+	CPU cpu;
+	uint8_t trace[COVERAGE_SIZE]; // this run's coverage
+	uint16_t touched[COVERAGE_SIZE]; // trace entries the run hit
+	uint8_t seen[COVERAGE_SIZE]; // local copy of virgin, saves locking
+	uint8_t input[MACHINE_FUZZ_MAX_INPUT];
+	size_t length; // of input
+	size_t position; // next byte the guest reads
+};
+
+// Read character hook, the guest gets 0xFF once the input runs out
+static int Fuzz_read(void *context) {
+	Fuzz_worker *w = (Fuzz_worker *) context;
+	if (w->position < w->length) {
+		return w->input[w->position++];
+	}
+	return EOF;
+}
+
+// Write character hook, output is thrown away
+static void Fuzz_write(void *context, int c) {
+}
+
+// xorshift64* random numbers, one stream per worker
+static uint64_t Random(Fuzz_worker *w) {
+	w->random ^= w->random >> 12;
+	w->random ^= w->random << 25;
+	w->random ^= w->random >> 27;
+	return w->random * 0x2545F4914F6CDD1DULL;
+}
+
+// AFL style hit count buckets, so loops only count when they change a lot
+static uint8_t Bucket(uint8_t hits) {
+	if (hits <= 3) return hits == 3 ? 4 : hits;
+	if (hits <= 7) return 8;
+	if (hits <= 15) return 16;
+	if (hits <= 31) return 32;
+	if (hits <= 127) return 64;
+	return 128;
+}
+
+// Bytes that tend to matter to programs reading characters
+static const uint8_t Interesting[] = {
+	0x00, 0x01, 0x7F, 0x80, 0xFF, '\n', '\r', ' ', '0', '9', 'A', 'z', '-', '+'
+};
+
+// Build the next input from a corpus entry with a few stacked changes
+static void Mutate(Fuzz_worker *w) {
+	Fuzz_shared *shared = w->shared;
+	size_t count = __atomic_load_n(&shared->corpus_count, __ATOMIC_ACQUIRE);
+	Fuzz_input *base = shared->corpus[Random(w) % count];
+	memcpy(w->input, base->data, base->length);
+	w->length = base->length;
+	size_t max = shared->max_length;
+
+	int changes = 1 << (Random(w) % 4);
+	for (int i = 0; i < changes; i++) {
+		size_t at = w->length ? Random(w) % w->length : 0;
+		switch (Random(w) % 8) {
+			case 0: // flip a bit
+				if (w->length) w->input[at] ^= 1 << (Random(w) % 8);
+				break;
+			case 1: // random byte
+				if (w->length) w->input[at] = Random(w);
+				break;
+			case 2: // interesting byte
+				if (w->length) w->input[at] = Interesting[Random(w) % sizeof(Interesting)];
+				break;
+			case 3: // small add or subtract
+				if (w->length) w->input[at] += (Random(w) % 33) - 16;
+				break;
+			case 4: // insert a byte
+				if (w->length < max) {
+					at = Random(w) % (w->length + 1);
+					memmove(&w->input[at + 1], &w->input[at], w->length - at);
+					w->input[at] = Random(w);
+					w->length++;
+				}
+				break;
+			case 5: // delete a byte
+				if (w->length) {
+					memmove(&w->input[at], &w->input[at + 1], w->length - at - 1);
+					w->length--;
+				}
+				break;
+			case 6: { // repeat a chunk
+				if (w->length == 0) break;
+				size_t size = 1 + Random(w) % (w->length - at);
+				if (size > max - w->length) size = max - w->length;
+				memmove(&w->input[at + size], &w->input[at], w->length - at);
+				w->length += size;
+				break;
+			}
+			case 7: { // splice in the tail of another input
+				Fuzz_input *other = shared->corpus[Random(w) % count];
+				if (other->length == 0) break;
+				size_t from = Random(w) % other->length;
+				size_t size = other->length - from;
+				if (size > max - at) size = max - at;
+				memcpy(&w->input[at], &other->data[from], size);
+				if (at + size > w->length) w->length = at + size;
+				break;
+			}
+		}
+	}
+}
+
+// Keep the input if its coverage has anything the corpus has not seen,
+// then clear the entries the run touched for the next run
+static void Check_coverage(Fuzz_worker *w) {
+	uint32_t count = w->cpu.Touched_count;
+	if (count == COVERAGE_SIZE) { // list filled up, make it from the map
+		count = 0;
+		for (uint32_t i = 0; i < COVERAGE_SIZE; i++) {
+			if (w->trace[i] != 0) {
+				w->touched[count++] = i;
+			}
+		}
+	}
+	bool fresh = false;
+	for (uint32_t i = 0; i < count && !fresh; i++) {
+		uint16_t edge = w->touched[i];
+		if (w->trace[edge] != 0 && (Bucket(w->trace[edge]) & ~w->seen[edge])) {
+			fresh = true;
+		}
+	}
+
+	if (fresh) {
+		Fuzz_shared *shared = w->shared;
+		pthread_mutex_lock(&shared->lock);
+		bool added = false;
+		for (uint32_t i = 0; i < count; i++) {
+			uint16_t edge = w->touched[i];
+			uint8_t bucket = w->trace[edge] ? Bucket(w->trace[edge]) : 0;
+			if (bucket & ~shared->virgin[edge]) {
+				shared->virgin[edge] |= bucket;
+				added = true;
+			}
+		}
+		if (added && shared->corpus_count < MAX_CORPUS) {
+			Fuzz_input *entry = (Fuzz_input *) malloc(sizeof(Fuzz_input));
+			if (entry != NULL) {
+				entry->length = w->length;
+				memcpy(entry->data, w->input, w->length);
+				shared->corpus[shared->corpus_count] = entry;
+				__atomic_store_n(&shared->corpus_count, shared->corpus_count + 1,
+				  __ATOMIC_RELEASE);
+			}
+		}
+		memcpy(w->seen, shared->virgin, COVERAGE_SIZE);
+		pthread_mutex_unlock(&shared->lock);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		w->trace[w->touched[i]] = 0;
+	}
+	w->cpu.Touched_count = 0;
+}
+
+// Record a run that stopped on anything but a halt
+static void Check_crash(Fuzz_worker *w, int status) {
+	Fuzz_shared *shared = w->shared;
+	machine_fuzz_result_t *result = shared->result;
+	uint32_t pc = w->cpu.Get_register_value(PCR_REGISTER);
+
+	pthread_mutex_lock(&shared->lock);
+	int i = 0;
+	while (i < result->num_crashes &&
+	  (result->crashes[i].status != status || result->crashes[i].pc != pc)) {
+		i++;
+	}
+	if (i < result->num_crashes) { // seen before
+		result->crashes[i].count++;
+	}
+	else if (i < MACHINE_FUZZ_MAX_CRASHES) {
+		machine_fuzz_crash_t *crash = &result->crashes[i];
+		crash->status = status;
+		crash->pc = pc;
+		crash->count = 1;
+		crash->length = w->length;
+		memcpy(crash->input, w->input, w->length);
+		result->num_crashes++;
+	}
+	pthread_mutex_unlock(&shared->lock);
+}
+
+// Worker thread, runs until all the executions have been handed out
+static void *Fuzz_work(void *argument) {
+	Fuzz_worker *w = (Fuzz_worker *) argument;
+	Fuzz_shared *shared = w->shared;
+	uint64_t done = 0;
+
+	while (__atomic_fetch_add(&shared->claimed, 1, __ATOMIC_RELAXED) <
+	  shared->options->executions) {
+		Mutate(w);
+		w->cpu.Restore(shared->memory, shared->regs);
+		w->cpu.Prev_location = 0;
+		w->position = 0;
+
+		int status = w->cpu.Run(shared->options->budget);
+		Check_coverage(w);
+		if (status != INSTRUCTION_HALT) {
+			Check_crash(w, status);
+		}
+		done++;
+	}
+	__atomic_fetch_add(&shared->done, done, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+// Fuzz the program in the target's memory, starting from its registers
+int Fuzz(CPU *target, const machine_fuzz_options_t *options,
+  machine_fuzz_result_t *result) {
+
+	int workers = options->workers;
+	if (workers < 1 || workers > MAX_FUZZ_WORKERS || options->budget == 0 ||
+	  options->seed_length > MACHINE_FUZZ_MAX_INPUT ||
+	  (options->seed == NULL && options->seed_length != 0)) {
+		return MACHINE_ERROR;
+	}
+
+	Fuzz_shared *shared = new (std::nothrow) Fuzz_shared;
+	Fuzz_input *seed = (Fuzz_input *) malloc(sizeof(Fuzz_input));
+	if (shared == NULL || seed == NULL) {
+		delete shared;
+		free(seed);
+		return MACHINE_ERROR;
+	}
+	memset(result, 0, sizeof(*result));
+	shared->options = options;
+	shared->result = result;
+	shared->max_length = options->max_length;
+	if (shared->max_length == 0 || shared->max_length > MACHINE_FUZZ_MAX_INPUT) {
+		shared->max_length = MACHINE_FUZZ_MAX_INPUT;
+	}
+	target->Snapshot(shared->memory, shared->regs);
+	pthread_mutex_init(&shared->lock, NULL);
+	memset(shared->virgin, 0, COVERAGE_SIZE);
+	shared->claimed = 0;
+	shared->done = 0;
+
+	seed->length = options->seed_length;
+	if (seed->length != 0) {
+		memcpy(seed->data, options->seed, seed->length);
+	}
+	shared->corpus[0] = seed;
+	shared->corpus_count = 1;
+
+	uint64_t random = options->random_seed ? options->random_seed :
+	  (uint64_t) time(NULL);
+	Fuzz_worker *pool[MAX_FUZZ_WORKERS];
+	int started = 0;
+	double start = Host_clock();
+	for (int i = 0; i < workers; i++) {
+		Fuzz_worker *w = new (std::nothrow) Fuzz_worker;
+		if (w == NULL || w->cpu.Memory == NULL) {
+			delete w;
+			break;
+		}
+		w->shared = shared;
+		w->random = (random + i + 1) * 0x9E3779B97F4A7C15ULL | 1;
+		w->cpu.Set_io(Fuzz_read, Fuzz_write, w);
+		w->cpu.Coverage = w->trace;
+		w->cpu.Touched = w->touched;
+		memset(w->trace, 0, COVERAGE_SIZE);
+		memset(w->seen, 0, COVERAGE_SIZE);
+		pool[i] = w;
+		if (pthread_create(&w->thread, NULL, Fuzz_work, w) != 0) {
+			delete w;
+			break;
+		}
+		started++;
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(pool[i]->thread, NULL);
+		delete pool[i];
+	}
+
+	result->executions = shared->done;
+	result->seconds = Host_clock() - start;
+	result->corpus = shared->corpus_count;
+	for (size_t i = 0; i < COVERAGE_SIZE; i++) {
+		if (shared->virgin[i]) {
+			result->edges++;
+		}
+	}
+	for (size_t i = 0; i < shared->corpus_count; i++) {
+		free(shared->corpus[i]);
+	}
+	pthread_mutex_destroy(&shared->lock);
+	delete shared;
+	return started == workers ? MACHINE_OK : MACHINE_ERROR;
+}
@@ -0,0 +1,15 @@
+/* fuzz.h - coverage guided fuzzing of guest programs through the read
+ * character instruction.  Internal to the library, libmachine.h has the
+ * C interface and the option and result structures.*/
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "cpu.h"
+#include "libmachine.h"
+
+// Fuzz the program in the target's memory, starting from its registers
+int Fuzz(CPU *target, const machine_fuzz_options_t *options,
+  machine_fuzz_result_t *result);
+
+#endif
@@ -0,0 +1,28 @@
+/* host.h - small host helpers shared by the library and the tools
+ * built beside it.  Header only, so tools like machine-top can use
+ * them without linking the library.*/
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Host monotonic clock in seconds
+static inline double Host_clock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Copy words one relaxed atomic access at a time, for guest memory
+// other cores may be using while the copy is made
+static inline void Copy_words(int32_t *to, const int32_t *from, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		__atomic_store_n(&to[i], __atomic_load_n(&from[i], __ATOMIC_RELAXED),
+		  __ATOMIC_RELAXED);
+	}
+}
+
+#endif
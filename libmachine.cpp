@@ -0,0 +1,714 @@
+/* libmachine.cpp - C interface to the emulated hypothetical computer.
+ * Thin wrappers around the CPU class, argument checking is done here
+ * so the CPU itself can stay unchecked and fast.  Nothing may throw
+ * out through the C interface, so allocations use nothrow new.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <new>
+#include "cpu.h"
+#include "libmachine.h"
+#include "fuzz.h"
+#include "replay.h"
+#include "publisher.h"
+#include "cost.h"
+#include "host.h"
+
+#if MACHINE_MEMORY_SIZE != MEMORY_SIZE || MACHINE_NUM_REGISTERS != NUM_REGISTERS \
+  || MACHINE_MAX_BREAKPOINTS != MAX_BREAKPOINTS \
+  || MACHINE_MAX_WATCHPOINTS != MAX_WATCHPOINTS \
+  || MACHINE_MAX_CORES != MAX_CORES || MACHINE_MAX_PORTS != MAX_PORTS \
+  || MACHINE_CHANNEL_SEND != CHANNEL_SEND \
+  || MACHINE_CHANNEL_RECEIVE != CHANNEL_RECEIVE \
+  || MACHINE_PC_REGISTER != PCR_REGISTER || MACHINE_SP_REGISTER != SP_REGISTER
+#error libmachine.h and cpu.h disagree on the machine limits
+#endif
+
+// A machine is a primary CPU owning memory and devices, plus any
+// secondary cores sharing them
+struct machine {
+	CPU cpu;
+	CPU *cores[MAX_CORES]; // cores[0] is cpu
+	int num_cores;
+	CPU *core; // selected core, the per-core calls act on it
+	double run_seconds; // host time spent in machine_run since the reset
+	double reset_time; // when the statistics were last reset
+	machine_read_fn reader; // hooks from machine_set_io
+	machine_write_fn writer;
+	void *io_context;
+	IoLog log; // sits in front of the hooks while recording or replaying
+	Publisher telemetry; // shared memory slot, if attached
+	uint64_t runs; // runs and steps, for telemetry
+	uint64_t faults; // of those, how many stopped on a fault
+	bool smp_running; // the other cores are busy on their own threads
+	telemetry_slot_t smp_base; // their counts when the SMP run started
+	CostModel *costs; // cycle cost model, NULL unless enabled
+	CPU *costed; // the core it is attached to
+	int watch_core; // core that stopped the last run on a watchpoint
+};
+
+// Check that count words at address are all inside memory
+static bool In_memory(uint32_t address, size_t count) {
+	return address <= MEMORY_SIZE && count <= MEMORY_SIZE - address;
+}
+
+// Add the counters of cores first to last - 1 into values
+static void Add_counters(machine_t *vm, int first, int last,
+  telemetry_slot_t *values) {
+	for (int i = first; i < last; i++) {
+		CPU *core = vm->cores[i];
+		values->instructions += core->Instructions;
+		values->bytes_in += core->Chars_in +
+		  core->Sectors_read * SECTOR_SIZE * sizeof(int32_t);
+		values->bytes_out += core->Chars_out +
+		  core->Sectors_written * SECTOR_SIZE * sizeof(int32_t);
+	}
+}
+
+// Fill in and publish the telemetry slot.  During an SMP run only core
+// 0 is read, the others count as they were when the run started.
+static void Publish(machine_t *vm, uint32_t state, int status,
+  double running) {
+	telemetry_slot_t values;
+	if (vm->smp_running) {
+		values = vm->smp_base;
+		Add_counters(vm, 0, 1, &values);
+	}
+	else {
+		memset(&values, 0, sizeof(values));
+		Add_counters(vm, 0, vm->num_cores, &values);
+	}
+	values.state = state;
+	values.status = status;
+	CPU *shown = vm->smp_running ? vm->cores[0] : vm->core;
+	values.pc = shown->Get_register_value(PCR_REGISTER);
+	values.cores = vm->num_cores;
+	values.faults = vm->faults;
+	values.runs = vm->runs;
+	values.run_seconds = vm->run_seconds + running;
+	vm->telemetry.Publish(&values);
+}
+
+// Count a finished run or step and publish how it stopped.  A machine
+// that halted or faulted is done with its channels.
+static void Note_stop(machine_t *vm, int status) {
+	bool fault = (status == MACHINE_INVALID ||
+	  status == MACHINE_NOT_IMPLEMENTED || status == MACHINE_ADDRESS_FAULT);
+	if (status == MACHINE_HALT || fault) {
+		vm->cpu.Close_ports();
+	}
+	vm->runs++;
+	if (fault) {
+		vm->faults++;
+	}
+	if (vm->telemetry.Attached()) {
+		Publish(vm, TELEMETRY_STOPPED, status, 0);
+	}
+}
+
+// Run a core in slices of TELEMETRY_SLICE instructions, publishing
+// between them so the run loop itself is untouched
+static int Run_published(machine_t *vm, CPU *core, uint64_t limit) {
+	double start = Host_clock();
+	uint64_t left = limit;
+	int status;
+	while (true) {
+		Publish(vm, TELEMETRY_RUNNING, 0, Host_clock() - start);
+		uint64_t slice = (limit == 0 || left > TELEMETRY_SLICE) ?
+		  TELEMETRY_SLICE : left;
+		status = core->Run(slice); // reports a breakpoint the slice ends on
+		if (status != 0 || (limit != 0 && (left -= slice) == 0)) {
+			break;
+		}
+	}
+	return status;
+}
+
+machine_t *machine_create(void) {
+	machine_t *vm = new (std::nothrow) machine;
+	if (vm == NULL) {
+		return NULL;
+	}
+	if (vm->cpu.Memory == NULL) { // no room for memory
+		delete vm;
+		return NULL;
+	}
+	vm->cores[0] = &vm->cpu;
+	vm->num_cores = 1;
+	vm->core = &vm->cpu;
+	vm->run_seconds = 0;
+	vm->reset_time = Host_clock();
+	vm->reader = NULL;
+	vm->writer = NULL;
+	vm->io_context = NULL;
+	vm->runs = 0;
+	vm->faults = 0;
+	vm->smp_running = false;
+	vm->costs = NULL;
+	vm->costed = NULL;
+	vm->watch_core = 0;
+	return vm;
+}
+
+void machine_destroy(machine_t *vm) {
+	if (vm->log.Get_mode() != IO_LOG_IDLE) { // finish the log off
+		machine_log_stop(vm, NULL);
+	}
+	vm->telemetry.Detach();
+	machine_cost_disable(vm);
+	machine_set_cores(vm, 1);
+	delete vm;
+}
+
+int machine_set_cores(machine_t *vm, int cores) {
+	if (cores < 1 || cores > MAX_CORES) {
+		return MACHINE_ERROR;
+	}
+	if (vm->log.Get_mode() != IO_LOG_IDLE &&
+	  vm->log.Get_core()->Core_id >= cores) { // the log stamps with it
+		return MACHINE_ERROR;
+	}
+	if (vm->costed != NULL && vm->costed->Core_id >= cores) { // going away
+		machine_cost_disable(vm);
+	}
+	while (vm->num_cores > cores) {
+		delete vm->cores[--vm->num_cores];
+	}
+	vm->watch_core = 0;
+	while (vm->num_cores < cores) {
+		CPU *core = new (std::nothrow) CPU(&vm->cpu);
+		if (core == NULL) {
+			vm->core = &vm->cpu;
+			return MACHINE_ERROR;
+		}
+		core->Core_id = vm->num_cores;
+		vm->cores[vm->num_cores++] = core;
+	}
+	vm->core = &vm->cpu;
+	return MACHINE_OK;
+}
+
+int machine_get_cores(machine_t *vm) {
+	return vm->num_cores;
+}
+
+int machine_select_core(machine_t *vm, int core) {
+	if (core < 0 || core >= vm->num_cores) {
+		return MACHINE_ERROR;
+	}
+	vm->core = vm->cores[core];
+	return MACHINE_OK;
+}
+
+// Thread body for one core of an SMP run.  Cores run in slices of
+// SMP_SLICE instructions and check the shared stop flag between them,
+// the first core to stop for any reason sets it.
+#define SMP_SLICE 0x10000
+
+struct Core_run {
+	CPU *cpu;
+	uint64_t limit;
+	int status;
+	int *stop; // shared by all the cores of the run
+	machine_t *publish; // core 0 publishes telemetry if attached, else NULL
+};
+
+static void *Run_core(void *argument) {
+	Core_run *run = (Core_run *) argument;
+	CPU *core = run->cpu;
+	double start = Host_clock();
+	uint64_t left = run->limit;
+	int status;
+	while (true) {
+		if (run->publish != NULL) {
+			Publish(run->publish, TELEMETRY_RUNNING, 0, Host_clock() - start);
+		}
+		uint64_t slice = (run->limit == 0 || left > SMP_SLICE) ?
+		  SMP_SLICE : left;
+		status = core->Run(slice); // reports a breakpoint the slice ends on
+		if (status != 0 || (run->limit != 0 && (left -= slice) == 0)) {
+			break;
+		}
+		if (__atomic_load_n(run->stop, __ATOMIC_ACQUIRE)) {
+			status = MACHINE_STOPPED;
+			break;
+		}
+	}
+	if (status != MACHINE_STOPPED) {
+		__atomic_store_n(run->stop, 1, __ATOMIC_RELEASE);
+	}
+	run->status = status;
+	return NULL;
+}
+
+// How serious a core's status is when combining them, higher wins
+static int Stop_rank(int status) {
+	switch (status) {
+		case MACHINE_STOPPED: return 0;
+		case MACHINE_HALT: return 1;
+		case 0: return 2; // limit
+		case MACHINE_BREAKPOINT:
+		case MACHINE_WATCHPOINT: return 3;
+		default: return 4; // faults and host failures
+	}
+}
+
+int machine_run_smp(machine_t *vm, uint64_t limit, int *statuses) {
+	Core_run runs[MAX_CORES];
+	pthread_t threads[MAX_CORES];
+	double start = Host_clock();
+	int stop = 0;
+
+	for (int i = 0; i < vm->num_cores; i++) {
+		runs[i].cpu = vm->cores[i];
+		runs[i].limit = limit;
+		runs[i].status = 0;
+		runs[i].stop = &stop;
+		runs[i].publish = NULL;
+	}
+	if (vm->telemetry.Attached()) {
+		memset(&vm->smp_base, 0, sizeof(vm->smp_base));
+		Add_counters(vm, 1, vm->num_cores, &vm->smp_base);
+		vm->smp_running = true;
+		runs[0].publish = vm;
+	}
+	int started = 1; // core 0 runs on this thread
+	for (; started < vm->num_cores; started++) {
+		if (pthread_create(&threads[started], NULL, Run_core, &runs[started]) != 0) {
+			break;
+		}
+	}
+	Run_core(&runs[0]);
+	for (int i = 1; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	vm->run_seconds += Host_clock() - start;
+	vm->smp_running = false;
+
+	int status = MACHINE_STOPPED;
+	for (int i = 0; i < vm->num_cores; i++) {
+		int core_status = i < started ? runs[i].status : MACHINE_ERROR;
+		if (statuses != NULL) {
+			statuses[i] = core_status;
+		}
+		if (Stop_rank(core_status) > Stop_rank(status)) {
+			status = core_status;
+			if (status == MACHINE_WATCHPOINT) {
+				vm->watch_core = i;
+			}
+		}
+	}
+	Note_stop(vm, status);
+	return status;
+}
+
+// A group run is one machine_run per host thread
+struct Group_run {
+	machine_t *vm;
+	uint64_t limit;
+	int status;
+};
+
+static void *Run_group_member(void *argument) {
+	Group_run *run = (Group_run *) argument;
+	run->status = machine_run(run->vm, run->limit, NULL);
+	return NULL;
+}
+
+int machine_run_group(machine_t **vms, int count, uint64_t limit,
+  int *statuses) {
+	if (count < 1) {
+		return MACHINE_ERROR;
+	}
+	Group_run *runs = new (std::nothrow) Group_run[count];
+	pthread_t *threads = new (std::nothrow) pthread_t[count];
+	if (runs == NULL || threads == NULL) {
+		delete[] runs;
+		delete[] threads;
+		return MACHINE_ERROR;
+	}
+	int status = MACHINE_OK;
+	for (int i = 0; i < count; i++) {
+		runs[i].vm = vms[i];
+		runs[i].limit = limit;
+		runs[i].status = MACHINE_ERROR; // if its thread never starts
+	}
+	int started = 0;
+	for (; started < count; started++) {
+		if (pthread_create(&threads[started], NULL, Run_group_member,
+		  &runs[started]) != 0) {
+			status = MACHINE_ERROR;
+			break;
+		}
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (int i = 0; statuses != NULL && i < count; i++) {
+		statuses[i] = runs[i].status;
+	}
+	delete[] runs;
+	delete[] threads;
+	return status;
+}
+
+machine_channel_t *machine_channel_create(uint32_t words) {
+	Channel *channel = new (std::nothrow) Channel(words);
+	if (channel == NULL) {
+		return NULL;
+	}
+	if (!channel->Ok()) {
+		delete channel;
+		return NULL;
+	}
+	return (machine_channel_t *) channel;
+}
+
+void machine_channel_destroy(machine_channel_t *channel) {
+	delete (Channel *) channel;
+}
+
+int machine_connect(machine_t *vm, int port, machine_channel_t *channel,
+  int end) {
+	if (end != CHANNEL_SEND && end != CHANNEL_RECEIVE) {
+		return MACHINE_ERROR;
+	}
+	return vm->cpu.Connect(port, (Channel *) channel, end) == 0 ?
+	  MACHINE_OK : MACHINE_ERROR;
+}
+
+int machine_disconnect(machine_t *vm, int port) {
+	if (port < 0 || port >= MAX_PORTS) {
+		return MACHINE_ERROR;
+	}
+	vm->cpu.Disconnect(port);
+	return MACHINE_OK;
+}
+
+int machine_load_image(machine_t *vm, const char *path, uint32_t address) {
+	FILE *image = fopen(path, "rb");
+	if (image == NULL || address >= MEMORY_SIZE) {
+		if (image != NULL) {
+			fclose(image);
+		}
+		return MACHINE_ERROR;
+	}
+	size_t count = fread(&vm->cpu.Memory[address], sizeof(int32_t),
+	  MEMORY_SIZE - address, image);
+	int status = ferror(image) ? MACHINE_ERROR : MACHINE_OK;
+	fclose(image);
+	vm->cpu.Refresh_breakpoints(address, count);
+	vm->cpu.Code_written(address, count);
+	return status;
+}
+
+int32_t machine_get_register(machine_t *vm, int reg) {
+	if (reg < 0 || reg >= NUM_REGISTERS) {
+		return 0;
+	}
+	return vm->core->Get_register_value(reg);
+}
+
+int machine_set_register(machine_t *vm, int reg, int32_t value) {
+	if (reg < 0 || reg >= NUM_REGISTERS) {
+		return MACHINE_ERROR;
+	}
+	vm->core->Store_value_in_register(reg, value);
+	return MACHINE_OK;
+}
+
+int machine_get_registers(machine_t *vm, int32_t *regs) {
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		regs[i] = vm->core->Get_register_value(i);
+	}
+	return MACHINE_OK;
+}
+
+int machine_set_registers(machine_t *vm, const int32_t *regs) {
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		vm->core->Store_value_in_register(i, regs[i]);
+	}
+	return MACHINE_OK;
+}
+
+int machine_read_memory(machine_t *vm, uint32_t address, int32_t *words,
+  size_t count) {
+	if (!In_memory(address, count)) {
+		return MACHINE_ERROR;
+	}
+	memcpy(words, &vm->cpu.Memory[address], count * sizeof(int32_t));
+	vm->cpu.Hide_breakpoints(address, words, count);
+	return MACHINE_OK;
+}
+
+int machine_write_memory(machine_t *vm, uint32_t address,
+  const int32_t *words, size_t count) {
+	if (!In_memory(address, count)) {
+		return MACHINE_ERROR;
+	}
+	memcpy(&vm->cpu.Memory[address], words, count * sizeof(int32_t));
+	vm->cpu.Refresh_breakpoints(address, count);
+	vm->cpu.Code_written(address, count);
+	return MACHINE_OK;
+}
+
+int machine_step(machine_t *vm) {
+	int status = vm->core->Step();
+	if (status == MACHINE_WATCHPOINT) {
+		vm->watch_core = vm->core->Core_id;
+	}
+	Note_stop(vm, status);
+	return status;
+}
+
+int machine_run(machine_t *vm, uint64_t limit, uint64_t *executed) {
+	uint64_t before = vm->core->Instructions;
+	double start = Host_clock();
+	int status = vm->telemetry.Attached() ?
+	  Run_published(vm, vm->core, limit) : vm->core->Run(limit);
+	vm->run_seconds += Host_clock() - start;
+	if (status == MACHINE_WATCHPOINT) {
+		vm->watch_core = vm->core->Core_id;
+	}
+	Note_stop(vm, status);
+	if (executed != NULL) {
+		*executed = vm->core->Instructions - before;
+	}
+	return status;
+}
+
+int machine_test(machine_t *vm) {
+	return vm->core->Test();
+}
+
+// Point every core at the I/O hooks, or at the log in front of them
+static void Install_io(machine_t *vm) {
+	vm->log.Set_io(vm->reader, vm->writer, vm->io_context);
+	for (int i = 0; i < vm->num_cores; i++) {
+		if (vm->log.Get_mode() != IO_LOG_IDLE) {
+			vm->cores[i]->Set_io(IoLog::Read, IoLog::Write, &vm->log);
+		}
+		else {
+			vm->cores[i]->Set_io(vm->reader, vm->writer, vm->io_context);
+		}
+	}
+}
+
+void machine_set_io(machine_t *vm, machine_read_fn reader,
+  machine_write_fn writer, void *context) {
+	vm->reader = reader;
+	vm->writer = writer;
+	vm->io_context = context;
+	Install_io(vm);
+}
+
+int machine_record(machine_t *vm, const char *path) {
+	if (vm->log.Record(path, vm->core) != 0) {
+		return MACHINE_ERROR;
+	}
+	Install_io(vm);
+	return MACHINE_OK;
+}
+
+int machine_replay(machine_t *vm, const char *path) {
+	if (vm->log.Replay(path, vm->core) != 0) {
+		return MACHINE_ERROR;
+	}
+	Install_io(vm);
+	return MACHINE_OK;
+}
+
+int machine_log_stop(machine_t *vm, machine_replay_result_t *result) {
+	if (vm->log.Get_mode() == IO_LOG_IDLE) {
+		return MACHINE_ERROR;
+	}
+	int status = vm->log.Stop(machine_state_hash(vm), result);
+	Install_io(vm);
+	return status == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+uint64_t machine_state_hash(machine_t *vm) {
+	int32_t words[256]; // memory a piece at a time, breakpoints hidden
+	uint64_t hash = 0xCBF29CE484222325ULL; // FNV-1a 64 bit
+	for (uint32_t address = 0; address < MEMORY_SIZE; address += 256) {
+		memcpy(words, &vm->cpu.Memory[address], sizeof(words));
+		vm->cpu.Hide_breakpoints(address, words, 256);
+		const uint8_t *bytes = (const uint8_t *) words;
+		for (size_t i = 0; i < sizeof(words); i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+		}
+	}
+	for (int i = 0; i < vm->num_cores; i++) {
+		for (int reg = 0; reg < NUM_REGISTERS; reg++) {
+			uint32_t value = vm->cores[i]->Get_register_value(reg);
+			for (int shift = 0; shift < 32; shift += 8) {
+				hash = (hash ^ ((value >> shift) & 0xFF)) * 0x100000001B3ULL;
+			}
+		}
+	}
+	return hash;
+}
+
+int machine_set_breakpoint(machine_t *vm, uint32_t address) {
+	return vm->cpu.Set_breakpoint(address) == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+int machine_clear_breakpoint(machine_t *vm, uint32_t address) {
+	return vm->cpu.Clear_breakpoint(address) == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+int machine_get_breakpoints(machine_t *vm, uint32_t *addresses) {
+	return vm->cpu.Get_breakpoints(addresses);
+}
+
+int machine_set_watchpoint(machine_t *vm, uint32_t address, int type) {
+	return vm->cpu.Set_watchpoint(address, type) == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+int machine_clear_watchpoint(machine_t *vm, uint32_t address) {
+	return vm->cpu.Clear_watchpoint(address) == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+int machine_get_watchpoints(machine_t *vm, uint32_t *addresses, int *types) {
+	return vm->cpu.Get_watchpoints(addresses, types);
+}
+
+int machine_watch_hit(machine_t *vm, uint32_t *address, int *type) {
+	CPU *hit = vm->cores[vm->watch_core];
+	*address = hit->Watch_hit_address;
+	*type = hit->Watch_hit_type;
+	return vm->watch_core;
+}
+
+int machine_fuzz(machine_t *vm, const machine_fuzz_options_t *options,
+  machine_fuzz_result_t *result) {
+	return Fuzz(vm->core, options, result);
+}
+
+int machine_attach_disk(machine_t *vm, const char *path, int32_t sectors) {
+	return vm->cpu.Disk.Attach(path, sectors) == 0 ? MACHINE_OK : MACHINE_ERROR;
+}
+
+void machine_detach_disk(machine_t *vm) {
+	vm->cpu.Disk.Detach();
+}
+
+int32_t machine_disk_sectors(machine_t *vm) {
+	return vm->cpu.Disk.Get_sectors();
+}
+
+const char *machine_disk_path(machine_t *vm) {
+	return vm->cpu.Disk.Get_path();
+}
+
+int machine_cost_enable(machine_t *vm, const char *path) {
+	CostModel *costs = new (std::nothrow) CostModel();
+	if (costs == NULL) {
+		return MACHINE_ERROR;
+	}
+	if (!costs->Ok() || (path != NULL && costs->Load(path) != 0)) {
+		delete costs;
+		return MACHINE_ERROR;
+	}
+	machine_cost_disable(vm);
+	costs->Reset(vm->core->Get_register_value(PCR_REGISTER));
+	vm->costs = costs;
+	vm->costed = vm->core;
+	vm->costed->Timing = costs;
+	return MACHINE_OK;
+}
+
+void machine_cost_disable(machine_t *vm) {
+	if (vm->costs == NULL) {
+		return;
+	}
+	vm->costed->Timing = NULL;
+	delete vm->costs;
+	vm->costs = NULL;
+	vm->costed = NULL;
+}
+
+uint64_t machine_cost_cycles(machine_t *vm) {
+	return vm->costs != NULL ? vm->costs->Cycles : 0;
+}
+
+// Fill entries from the function or block report
+static int Cost_report(machine_t *vm, machine_cost_entry_t *entries, int max,
+  bool functions) {
+	if (vm->costs == NULL || max <= 0) {
+		return 0;
+	}
+	uint32_t *addresses = new (std::nothrow) uint32_t[max];
+	uint64_t *counts = new (std::nothrow) uint64_t[max];
+	uint64_t *cycles = new (std::nothrow) uint64_t[max];
+	int listed = 0;
+	if (addresses != NULL && counts != NULL && cycles != NULL) {
+		listed = functions
+		  ? vm->costs->Functions(addresses, counts, cycles, max)
+		  : vm->costs->Blocks(addresses, counts, cycles, max);
+	}
+	for (int i = 0; i < listed; i++) {
+		entries[i].address = addresses[i];
+		entries[i].count = counts[i];
+		entries[i].cycles = cycles[i];
+	}
+	delete[] addresses;
+	delete[] counts;
+	delete[] cycles;
+	return listed;
+}
+
+int machine_cost_functions(machine_t *vm, machine_cost_entry_t *entries,
+  int max) {
+	return Cost_report(vm, entries, max, true);
+}
+
+int machine_cost_blocks(machine_t *vm, machine_cost_entry_t *entries,
+  int max) {
+	return Cost_report(vm, entries, max, false);
+}
+
+int machine_telemetry_attach(machine_t *vm, const char *name,
+  const char *label) {
+	int slot = vm->telemetry.Attach(name != NULL ? name : TELEMETRY_NAME,
+	  label != NULL ? label : "machine");
+	if (slot < 0) {
+		return MACHINE_ERROR;
+	}
+	Publish(vm, vm->runs == 0 ? TELEMETRY_IDLE : TELEMETRY_STOPPED, 0, 0);
+	return slot;
+}
+
+void machine_telemetry_detach(machine_t *vm) {
+	vm->telemetry.Detach();
+}
+
+void machine_get_stats(machine_t *vm, machine_stats_t *stats) {
+	memset(stats, 0, sizeof(*stats));
+	for (int i = 0; i < vm->num_cores; i++) { // totals over all cores
+		CPU *core = vm->cores[i];
+		stats->instructions += core->Instructions;
+		stats->branches += core->Branches;
+		stats->calls += core->Calls;
+		stats->loads += core->Loads;
+		stats->stores += core->Stores;
+		stats->io_operations += core->Io_operations;
+		stats->chars_in += core->Chars_in;
+		stats->chars_out += core->Chars_out;
+		stats->sectors_read += core->Sectors_read;
+		stats->sectors_written += core->Sectors_written;
+	}
+	stats->run_seconds = vm->run_seconds;
+	stats->wall_seconds = Host_clock() - vm->reset_time;
+}
+
+void machine_reset_stats(machine_t *vm) {
+	vm->log.Counters_reset();
+	for (int i = 0; i < vm->num_cores; i++) {
+		vm->cores[i]->Reset_counters();
+	}
+	vm->run_seconds = 0;
+	vm->reset_time = Host_clock();
+}
@@ -0,0 +1,248 @@
+/* libmachine.h - C interface to the emulated hypothetical computer.
+ * Lets other programs create and drive machines in-process instead of
+ * piping commands into the console.  Link with libmachine.a or
+ * libmachine.so.*/
+
+#ifndef LIBMACHINE_H
+#define LIBMACHINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MACHINE_NUM_REGISTERS 16
+#define MACHINE_PC_REGISTER 15 // program counter
+#define MACHINE_SP_REGISTER 14 // stack pointer, grows down
+#define MACHINE_MEMORY_SIZE 0x10000 // words of memory per machine
+#define MACHINE_MAX_BREAKPOINTS 32
+#define MACHINE_MAX_WATCHPOINTS 32
+#define MACHINE_MAX_CORES 16
+
+/* Return codes.  Run and step return 0 or one of the stop reasons,
+ * the other calls return MACHINE_OK or MACHINE_ERROR. */
+#define MACHINE_OK 0
+#define MACHINE_ERROR -1 // bad argument or host failure
+#define MACHINE_INVALID 1 // invalid instruction
+#define MACHINE_NOT_IMPLEMENTED 2 // instruction not implemented yet
+#define MACHINE_HALT 3 // halt instruction
+#define MACHINE_ADDRESS_FAULT 4 // program counter or data address outside memory
+#define MACHINE_BREAKPOINT 5 // stopped on a breakpoint
+#define MACHINE_WATCHPOINT 6 // stopped after a watched word was accessed
+#define MACHINE_STOPPED 7 // SMP only, another core stopped the run
+
+#define MACHINE_MAX_PORTS 16 // channel ports per machine
+#define MACHINE_CHANNEL_SEND 1 // channel ends
+#define MACHINE_CHANNEL_RECEIVE 2
+
+#define MACHINE_WATCH_READ 1 // watchpoint types, may be or'ed together
+#define MACHINE_WATCH_WRITE 2
+
+typedef struct machine machine_t;
+typedef struct machine_channel machine_channel_t;
+
+typedef struct machine_stats {
+	uint64_t instructions; // instructions retired
+	uint64_t branches; // taken branches, skips and returns
+	uint64_t calls; // calls
+	uint64_t loads; // memory words read by instructions
+	uint64_t stores; // memory words written by instructions
+	uint64_t io_operations; // I/O instructions
+	uint64_t chars_in; // characters read from the console
+	uint64_t chars_out; // characters written to the console
+	uint64_t sectors_read; // block device sectors read
+	uint64_t sectors_written; // block device sectors written
+	double run_seconds; // host time spent running since the reset
+	double wall_seconds; // host time since the reset
+} machine_stats_t;
+
+/* Fuzzing.  Inputs are fed through the read character instruction,
+ * each execution starts again from a snapshot of memory and the
+ * selected core's registers.  A run is a crash if it stops on anything
+ * but a halt; status 0 means it used up its instruction budget. */
+#define MACHINE_FUZZ_MAX_INPUT 4096 // bytes in one input
+#define MACHINE_FUZZ_MAX_CRASHES 32 // distinct crashes kept, by status and pc
+
+typedef struct machine_fuzz_options {
+	int workers; // host threads, each with its own copy of the machine
+	uint64_t executions; // total runs to do
+	uint64_t budget; // instructions allowed per run
+	size_t max_length; // longest input to try, at most MACHINE_FUZZ_MAX_INPUT
+	const uint8_t *seed; // first input, may be NULL if seed_length is 0
+	size_t seed_length;
+	uint64_t random_seed; // for the mutator
+} machine_fuzz_options_t;
+
+typedef struct machine_fuzz_crash {
+	int status; // how the run stopped
+	uint32_t pc; // where it stopped
+	uint64_t count; // times this crash was seen
+	size_t length; // first input that caused it
+	uint8_t input[MACHINE_FUZZ_MAX_INPUT];
+} machine_fuzz_crash_t;
+
+typedef struct machine_fuzz_result {
+	uint64_t executions; // runs done
+	double seconds; // host time taken
+	size_t corpus; // inputs kept for finding new coverage
+	size_t edges; // coverage map entries hit
+	int num_crashes;
+	machine_fuzz_crash_t crashes[MACHINE_FUZZ_MAX_CRASHES];
+} machine_fuzz_result_t;
+
+/* Record and replay of console input.  Recording logs each character
+ * the guest reads with the instruction count it was read at, replay
+ * feeds the log back instead of reading the real input.  Stopping
+ * either one compares the instruction count and a hash of memory and
+ * registers with the recording.  Counts are taken from the core that
+ * was selected when logging started, so replay is exact for single
+ * core runs. */
+typedef struct machine_replay_result {
+	int matched; // replay ended as recorded, always set after recording
+	uint64_t events; // characters logged or fed back
+	uint64_t mismatches; // characters read at another count, or not read
+	uint64_t instructions; // run on the logging core since the start
+	uint64_t expected_instructions;
+	uint64_t hash; // machine_state_hash when stopped
+	uint64_t expected_hash;
+} machine_replay_result_t;
+
+/* Cycle cost model.  Each instruction class is given a cost in
+ * cycles, from a file of "class cycles" lines or the built in table.
+ * Totals are kept per basic block, by the address it starts at, and
+ * per function, by the CALL target, each function's cycles not
+ * counting those of the functions it calls.  Only the core selected
+ * when the model was enabled is costed. */
+typedef struct machine_cost_entry {
+	uint32_t address; // block or function start
+	uint64_t count; // runs of the block, calls of the function
+	uint64_t cycles;
+} machine_cost_entry_t;
+
+/* I/O callbacks for the read and write character instructions */
+typedef int (*machine_read_fn)(void *context);
+typedef void (*machine_write_fn)(void *context, int c);
+
+/* create and destroy, a new machine has cleared memory and registers,
+ * create returns NULL if there is no room for one */
+machine_t *machine_create(void);
+void machine_destroy(machine_t *vm);
+
+/* load a raw image of host order 32 bit words at address */
+int machine_load_image(machine_t *vm, const char *path, uint32_t address);
+
+/* SMP, extra cores share memory, devices and breakpoints with core 0.
+ * New cores start with a copy of core 0's registers.  The register,
+ * step and run calls act on the selected core, core 0 by default;
+ * machine_run_smp runs every core on its own host thread until any
+ * of them stops, the others then stop with MACHINE_STOPPED.  It returns
+ * the most serious status of any core: a fault, then a breakpoint or
+ * watchpoint, then the limit, then a halt.  statuses (if not NULL)
+ * gets one per core.  The core selected when recording or replaying
+ * started can't be removed until the log is stopped. */
+int machine_set_cores(machine_t *vm, int cores);
+int machine_get_cores(machine_t *vm);
+int machine_select_core(machine_t *vm, int core);
+int machine_run_smp(machine_t *vm, uint64_t limit, int *statuses);
+
+/* registers */
+int32_t machine_get_register(machine_t *vm, int reg);
+int machine_set_register(machine_t *vm, int reg, int32_t value);
+int machine_get_registers(machine_t *vm, int32_t *regs); // all 16
+int machine_set_registers(machine_t *vm, const int32_t *regs); // all 16
+
+/* bulk memory access, the whole range must be inside memory */
+int machine_read_memory(machine_t *vm, uint32_t address, int32_t *words,
+  size_t count);
+int machine_write_memory(machine_t *vm, uint32_t address,
+  const int32_t *words, size_t count);
+
+/* execution, a limit of 0 runs until the machine stops */
+int machine_step(machine_t *vm);
+int machine_run(machine_t *vm, uint64_t limit, uint64_t *executed);
+int machine_test(machine_t *vm); // CPU test routine
+
+/* console I/O, NULL callbacks restore stdio */
+void machine_set_io(machine_t *vm, machine_read_fn reader,
+  machine_write_fn writer, void *context);
+
+/* breakpoints and watchpoints.  Breakpoints are trap words patched
+ * into memory, reading memory through this interface shows the
+ * original words.  Watchpoints only slow the run down while set. */
+int machine_set_breakpoint(machine_t *vm, uint32_t address);
+int machine_clear_breakpoint(machine_t *vm, uint32_t address);
+int machine_get_breakpoints(machine_t *vm, uint32_t *addresses); // count
+int machine_set_watchpoint(machine_t *vm, uint32_t address, int type);
+int machine_clear_watchpoint(machine_t *vm, uint32_t address);
+int machine_get_watchpoints(machine_t *vm, uint32_t *addresses, int *types);
+/* the watched word and access that stopped the last run or step,
+ * returns the number of the core that hit it */
+int machine_watch_hit(machine_t *vm, uint32_t *address, int *type);
+
+/* block storage device.  A non-zero sectors creates or grows the file
+ * to that size, zero attaches an existing file at its own size. */
+int machine_attach_disk(machine_t *vm, const char *path, int32_t sectors);
+void machine_detach_disk(machine_t *vm);
+int32_t machine_disk_sectors(machine_t *vm);
+const char *machine_disk_path(machine_t *vm);
+
+/* channels carry words one way between machines in this process, the
+ * guest sends and receives with X2 = 7 to E on a port connected to an
+ * end.  Each end takes one machine and one core.  A machine that halts
+ * or faults closes its ends, so the other side sees the end of the data.
+ * Destroy a channel once the machines on both ends are destroyed or
+ * disconnected from it. */
+machine_channel_t *machine_channel_create(uint32_t words);
+void machine_channel_destroy(machine_channel_t *channel);
+int machine_connect(machine_t *vm, int port, machine_channel_t *channel,
+  int end);
+int machine_disconnect(machine_t *vm, int port);
+
+/* run several machines at once, each on its own host thread, for
+ * machines connected by channels.  statuses gets one per machine. */
+int machine_run_group(machine_t **vms, int count, uint64_t limit,
+  int *statuses);
+
+/* fuzz the loaded program, result can be large so don't put it on a
+ * small stack */
+int machine_fuzz(machine_t *vm, const machine_fuzz_options_t *options,
+  machine_fuzz_result_t *result);
+
+/* record or replay console input, stop returns MACHINE_ERROR if a
+ * replay went differently, result may be NULL */
+int machine_record(machine_t *vm, const char *path);
+int machine_replay(machine_t *vm, const char *path);
+int machine_log_stop(machine_t *vm, machine_replay_result_t *result);
+
+/* FNV-1a hash of memory and every core's registers */
+uint64_t machine_state_hash(machine_t *vm);
+
+/* cost model, enable with path NULL for the built in costs, reports
+ * fill entries with the most expensive first and return how many */
+int machine_cost_enable(machine_t *vm, const char *path);
+void machine_cost_disable(machine_t *vm);
+uint64_t machine_cost_cycles(machine_t *vm);
+int machine_cost_functions(machine_t *vm, machine_cost_entry_t *entries,
+  int max);
+int machine_cost_blocks(machine_t *vm, machine_cost_entry_t *entries,
+  int max);
+
+/* live telemetry in a shared memory segment, see telemetry.h.  Attach
+ * claims a slot, name NULL uses the default segment, and returns the
+ * slot number.  Counters are published between slices of a run and
+ * when it stops, never per instruction. */
+int machine_telemetry_attach(machine_t *vm, const char *name,
+  const char *label);
+void machine_telemetry_detach(machine_t *vm);
+
+/* statistics, totals over all cores */
+void machine_get_stats(machine_t *vm, machine_stats_t *stats);
+void machine_reset_stats(machine_t *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+/* machine-top.cpp - shows the machines publishing telemetry, see
+ * telemetry.h.  Only maps the segment read only, so it can watch
+ * running machines without slowing or stopping them.
+ *
+ * usage: machine-top [-n name] [-i seconds] [-c count]
+ *   -n  shared memory segment, default /machine-telemetry
+ *   -i  time between samples, default 1 second
+ *   -c  samples to take, default 0 keeps going until interrupted
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "libmachine.h" // for the status codes, nothing is linked
+#include "telemetry.h"
+#include "host.h"
+
+#define EXIT_USAGE 1 // bad option
+#define EXIT_NO_SEGMENT 2 // nothing has published yet
+
+// Name for how a machine is doing
+static const char *State_name(const telemetry_slot_t *slot) {
+	if (kill(slot->pid, 0) != 0 && errno == ESRCH) {
+		return "dead";
+	}
+	switch (slot->state) {
+		case TELEMETRY_IDLE: return "idle";
+		case TELEMETRY_RUNNING: return "running";
+	}
+	switch (slot->status) { // stopped, say why
+		case 0: return "limit";
+		case MACHINE_INVALID: return "invalid";
+		case MACHINE_NOT_IMPLEMENTED: return "notimpl";
+		case MACHINE_HALT: return "halted";
+		case MACHINE_ADDRESS_FAULT: return "fault";
+		case MACHINE_BREAKPOINT: return "break";
+		case MACHINE_WATCHPOINT: return "watch";
+		default: return "stopped";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = TELEMETRY_NAME ;
+	double interval = 1.0 ;
+	long count = 0 ;
+	int option ;
+	while ((option = getopt(argc, argv, "n:i:c:")) != -1) {
+		switch (option) {
+			case 'n': name = optarg ; break;
+			case 'i': interval = atof(optarg) ; break;
+			case 'c': count = atol(optarg) ; break;
+			default:
+				fprintf(stderr,"usage: machine-top [-n name] [-i seconds] [-c count]\n");
+				return EXIT_USAGE;
+		}
+	}
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr,"machine-top: no telemetry segment %s\n",name);
+		return EXIT_NO_SEGMENT;
+	}
+	void *map = mmap(NULL, sizeof(telemetry_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr,"machine-top: unable to map %s\n",name);
+		return EXIT_NO_SEGMENT;
+	}
+	const telemetry_segment_t *segment = (const telemetry_segment_t *) map;
+	if (segment->magic != TELEMETRY_MAGIC) {
+		fprintf(stderr,"machine-top: %s is not a telemetry segment\n",name);
+		return EXIT_NO_SEGMENT;
+	}
+
+	static telemetry_slot_t last[TELEMETRY_SLOTS] ; // previous sample, for rates
+	double last_time = Host_clock() ;
+	bool clear = isatty(STDOUT_FILENO) && count != 1 ;
+	for (long sample = 0; count == 0 || sample < count; sample++) {
+		if (sample != 0) {
+			struct timespec pause ;
+			pause.tv_sec = (time_t) interval ;
+			pause.tv_nsec = (long) ((interval - pause.tv_sec) * 1e9) ;
+			nanosleep(&pause, NULL) ;
+		}
+		double now = Host_clock() ;
+		double elapsed = now - last_time ;
+		last_time = now ;
+
+		if (clear) {
+			printf("\033[H\033[2J");
+		}
+		printf("SLOT PID     LABEL            STATE    CORES PC       INSTRUCTIONS     MIPS     IN       OUT      FAULTS\n");
+		for (int i = 0; i < TELEMETRY_SLOTS; i++) {
+			telemetry_slot_t slot ;
+			if (__atomic_load_n(&segment->slot[i].pid, __ATOMIC_ACQUIRE) == 0 ||
+			  telemetry_read(&segment->slot[i], &slot) != 0 || slot.pid == 0) {
+				last[i].pid = 0 ;
+				continue;
+			}
+			double mips = 0 ;
+			if (sample != 0 && last[i].pid == slot.pid && elapsed > 0 &&
+			  slot.instructions >= last[i].instructions) {
+				mips = (slot.instructions - last[i].instructions) / elapsed / 1e6 ;
+			}
+			last[i] = slot ;
+			printf("%-4d %-7d %-16.16s %-8s %-5u %08X %-16llu %-8.2f %-8llu %-8llu %llu\n",
+			  i,slot.pid,slot.label,State_name(&slot),slot.cores,slot.pc,
+			  (unsigned long long) slot.instructions,mips,
+			  (unsigned long long) slot.bytes_in,
+			  (unsigned long long) slot.bytes_out,
+			  (unsigned long long) slot.faults);
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
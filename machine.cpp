@@ -1,4 +1,4 @@
-/* machine.cpp - A software emulated hypothetical computer in 'c++'
+/* machine.cpp - Console for a software emulated hypothetical computer in 'c++'
  * This project is part of a teaching/learning experience to implement a
  * fairly simple 32 bit computer architecture in the 'c' language.  
  * Procedure oriented and in-line code rather than class oriented code 
@@ -12,854 +12,1102 @@
  4/28/17 - improve UI allow multiple args on command line
  4/28/17 - stub out the first level instruction decode
  6/22/17 - fix code in CALL instruction
+ 10/19/26 - add memory mapped block storage device and 'attach' command
+ 10/19/26 - split the CPU out into libmachine, console now uses its C API
+ 10/19/26 - add script mode, bulk memory commands and 'run'
+ 10/19/26 - add breakpoints and watchpoints
+ 10/19/26 - add performance counters and 'stats' command
+ 10/19/26 - add SMP mode with atomic instructions, 'smp' and 'core' commands
+ 10/19/26 - add coverage guided fuzzing and 'fuzz' command
+ 10/19/26 - add console input record and replay, 'hash' command
+ 10/19/26 - add shared memory telemetry, 'telemetry' command and machine-top
+ 10/19/26 - add inter-machine channels and 'pipe' command
+ 10/19/26 - add cycle cost model and 'cost' command
  
  */
  
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
-/* Global constants */
-#define NUM_REGISTERS 16
-#define PCR_REGISTER 15  
-#define SP_REGISTER 14
-#define STATUS_REGISTER 0
-#define OVERFLOW_BIT 0x00000001
-#define MEMORY_SIZE 0X10000 // Set to 32k for now,can be expanded to 20 bits
-
-#define INSTRUCTION_INVALID 1 // return code for invalid instruction
-#define INSTRUCTION_NOT_IMPLEMENTED 2  // defined but not implemented yet
-#define INSTRUCTION_HALT 3 // return code for halt instruction encountered
-
-/*  Global Variables  - For speed */
-
-int32_t Memory[MEMORY_SIZE];
-
-
- 
+ #include <stdint.h>
+ #include <new>
+#include "libmachine.h"
 
 // Prototype class definitions
-class CPU;
 class Console;
 
-//********************************************************************
-// Class to implement the CPU
-//********************************************************************
-class CPU
-{
-
-	public:
-		CPU();	// Constructor
-		int Step(); // Step the CPU single instruction step
-		int Run(); // Run the CPU
-		int Test() ; // Run whatever code is in the test section
-		int32_t Get_register_value (int register_number) ; // get value
-		int Store_value_in_register(int register_number, int32_t value) ; // store value
-
+// Exit codes for scripted runs, taken from how the last 'run' stopped
+#define EXIT_HALTED 0 // halt instruction, or nothing was run
+#define EXIT_COMMAND_ERROR 1 // bad command, argument or file
+#define EXIT_LIMIT 2 // instruction limit ran out before a halt
+#define EXIT_INVALID 3 // invalid instruction
+#define EXIT_NOT_IMPLEMENTED 4 // instruction not implemented
+#define EXIT_ADDRESS_FAULT 5 // address outside memory
+#define EXIT_BREAKPOINT 6 // stopped on a breakpoint
+#define EXIT_WATCHPOINT 7 // stopped on a watchpoint
+#define EXIT_RUN_ERROR 8 // the run could not start, a core or stage thread failed
 
-	private:
+// ******************************************************************
+// Console support routines
+// ******************************************************************  
+// getarg function parses buffer into arguments, returning number
+// of arguments, or -1 if one is too long and argv[0] then holds the
+// start of it.
+#define MAX_ARGS 64 
+#define MAX_ARG_SIZE 80 
+#define LINE_SIZE 1024 // longest command line
+int getarg(char *buffer, char argv[][MAX_ARG_SIZE]) {
 
-		int32_t Regs[NUM_REGISTERS];
-		int Execute  (int32_t instruction); // Execute an instruction
-		int ProcessX7(int32_t instruction); // Process X7 non-zero instructions
-		int ProcessX6(int32_t instruction); // Process X6 non-zero instructions
-		int ProcessX5(int32_t instruction); // Process X5 non-zero instructions
-		int ProcessX4(int32_t instruction); // Process X4 non-zero instructions
-		int ProcessX3(int32_t instruction); // Process X3 non-zero instructions
-		int ProcessX2(int32_t instruction); // Process X2 non-zero instructions
-		int ProcessX1(int32_t instruction); // Process X1 non-zero instructions
-};	
+	int arg_count = 0 ;
+	char* ptr_string ;
 
-// CPU constructor  - set up object and clear memory and registers
-CPU::CPU(void) {
-	printf(" CPU object created \n");
-	for (int i = 0; i<NUM_REGISTERS; i++){	//Clear the registers
-		Regs[i] = 0;
-	};
-	for (int i = 0; i<MEMORY_SIZE; i++){	//Clear the memory
-		Memory[i] = 0;
-	};	
-};
-// CPU method to obtain register value (no value checking, do externally)
-int32_t CPU::Get_register_value(int register_number) {
+	ptr_string = strtok(buffer, " \t\r\n");
+	while (ptr_string != NULL && arg_count < MAX_ARGS) {
 
-		return (Regs[ register_number ]);
 
+//		printf(" %d %s\n",arg_count,ptr_string);
+		if (strlen(ptr_string) >= MAX_ARG_SIZE) { // would be cut short
+			strncpy(&argv[0][0],ptr_string,MAX_ARG_SIZE - 1) ;
+			argv[0][MAX_ARG_SIZE - 1] = 0 ;
+			return -1 ;
+		}
+		strcpy(&argv[arg_count][0],ptr_string) ;
+		arg_count++ ;
+		ptr_string = strtok (NULL," \t\r\n");
+	}
+	return arg_count ;
 }
 
-// CPU method to store a value in a register (no value checking, do externally)
-int CPU::Store_value_in_register (int register_number, int32_t value) {
-	Regs [register_number] = value ;
-	return 0 ;
+// gethex function decodes a hex argument, returning false if there
+// isn't one so nothing uninitialized gets used
+bool gethex(const char *text, uint32_t *value) {
+	unsigned int parsed ;
+	if (sscanf(text,"%x",&parsed) != 1) {
+		return false;
+	}
+	*value = parsed ;
+	return true;
 }
 
-// CPU method to handle instruction single step
-int CPU::Step(void) {
-
-	int address = Regs[PCR_REGISTER];
-	int instruction = Memory[address];  // Instruction to be executed
-
-	printf("CONS> Step -instruction at %08X is %08X \n",address,instruction);
-	return Execute(instruction); // just return with execution code
+// Guest console output hook for scripts, stdout is kept for the
+// console's own records so they can be parsed
+static void Script_write(void *context, int c) {
+	fputc(c, stderr);
 }
+/************************************************************
+ * Console Class
+ * **********************************************************/
+class Console
+{
+	public:
+		Console(bool script) ; // Console constructor, script is non-interactive
+		~Console() ; // Console destructor
+		int Start();		// Console runs until terminated
+		int Script(FILE *input); // Run commands from a file, no prompts
+		int Command(char *line); // Execute one command line
+		bool Finished() { return finish; } // 'q' has been seen
+		int Exit_status(); // exit code for the program
 
-// CPU method to execute an instruction
-int CPU::Execute(int32_t instruction){
-	
-// look for all zero's, halt instruction
-	if ( instruction == 0) { // halt
-		return INSTRUCTION_HALT ;
-	}
-	
-// look for non-zero X7 digit (high order hex digit)
-	 else if ( (instruction & 0xF0000000) != 0 ){ // process non_zero X7
-		return ProcessX7(instruction);
+	private:
+		machine_t *vm ; // the machine being controlled
+		bool scripted ; // no prompts, plain output, errors are fatal
+		bool finish ; // set by the 'q' command
+		bool ran ; // a 'run' or 'pipe' has finished
+		int run_status ; // how it stopped, MACHINE_ERROR if it could not start
+		int current_core ; // core selected with the 'core' command
+		bool Ask(const char *prompt, char *inbuf, int size);
+		int Error(const char *message, const char *detail);
+		void Report_stop(int status, uint64_t executed);
+		void Run_smp(uint64_t limit);
+		void Print_stats(void);
+		int Print_costs(int count);
+		int Fuzz(int num_args, char argv[MAX_ARGS][MAX_ARG_SIZE]);
+		int Log_stop(const char *name);
+		int Pipe(int num_args, char argv[MAX_ARGS][MAX_ARG_SIZE]);
+		const char *Watch_name(int type);
+		void Print_a_register(int regnum);
+		void Print_all_registers(void);
+		int Get_register_number();
+		int Print_memory_location(uint32_t address);
+		int Load_hex(const char *path, uint32_t address);
+		int Save_image(const char *path, uint32_t address, uint32_t count);
+		
+}; // end of Console class definition
+
+Console::Console(bool script) {   //Console constructor
+	scripted = script ;
+	finish = false ;
+	ran = false ;
+	run_status = MACHINE_OK ;
+	current_core = 0 ;
+	vm = machine_create();
+	if (vm == NULL) {
+		Error("Unable to create the machine", "out of memory");
+		exit(EXIT_COMMAND_ERROR);
 	}
-// look for non-zero X6 digit 
-	else if ( (instruction & 0x0F000000) != 0 ){ // process non_zero X6
-		return ProcessX6(instruction);	
+	if (scripted) {
+		machine_set_io(vm, NULL, Script_write, NULL);
 	}
-// look for non-zero X5 digit
-	else if ( (instruction & 0x00F00000) != 0) { // process non_zero X5
-		return ProcessX5(instruction);
-	}	
-// look for non-zero X4 digit
-	else if ( (instruction & 0x000F0000) != 0) { // process non-zero X4
-		return ProcessX4(instruction);
-	}
-	
-// look for non-zero X3 digit
-	else if ( (instruction & 0x0000F000) != 0) { // process non-zero X3
-		return ProcessX3(instruction);
+	else {
+		printf(" CPU object created \n");
 	}
-	
-// look for non-zero X2 digit
-	else if ( (instruction & 0x00000F00) != 0) { // process non-zero X2
-		return ProcessX2(instruction);
-	}	
-	
-// look for non-zero X1 digit
-	else if ( (instruction & 0x000000F0) != 0) { // process non-zero X1
-		return ProcessX1(instruction);
-	}		
-// no match, return bad instruction
-	
-	else return INSTRUCTION_NOT_IMPLEMENTED;
-
-
+}
 
+Console::~Console() {   //Console destructor
+	machine_destroy(vm);
 }
-// CPU method to handle X7 != 0 (Memory reference instructions)
-int CPU::ProcessX7(int32_t instruction) {
-	
-//	printf ("Instruction decoded as X7 %08X instruction \n");
 
-	int code = (instruction >> 28) & 0x0000000F ;// get op code
-//	printf("Hex code X7 is %01X \n",code);
-	
-	int idx_reg = (instruction >> 24) & 0x0000000F ; // get index reg
-//	printf("Index register is %01X \n",idx_reg);
-	
-	int dest_reg = (instruction >> 20) & 0x0000000F ; // get destination
-//	printf("Destination register is %01X \n",dest_reg);
-	
-	int32_t address = instruction & 0x000FFFFF ;// base address from instruction
-//	printf("Base address is %08X \n",address);
-	
-	if (idx_reg != 0) { // compute effective address
-		address = address +  Regs[idx_reg] ;
-//		printf("After index, address is %08X \n",address);
-	}
-	
-	// decode the instruction using a switch statement
-	switch (code) {
-		case 1: {  // load register
-			Regs [dest_reg] = Memory [address] ;
-			break;
-		}
-		case 2: { // store register
-			Memory [address] = Regs [dest_reg] ;
-			break;
-		}
-		case 3: { // add to register
-			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
-			Regs [dest_reg] += Memory [address] ;
-			break;
-		}
-		case 4: { // subract from register
-			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!!
-			Regs [dest_reg] -= Memory [address] ;
-			break;
-		}
-		case 5: { // branch to address
-			Regs [PCR_REGISTER] = address;
-			return 0; // return OK to bypass PCR increment
+// Mainline console method to run the console
+int Console::Start()
+{
+	char inbuf[LINE_SIZE] ; // input buffer
+	do {
+		printf("CONS?> ");
+		if (fgets( inbuf,LINE_SIZE,stdin) == NULL) { // end of input, quit
 			break;
-		
 		}
-		case 6: { // call
-			Regs [PCR_REGISTER]++; // Increment the program counter by 1 
-			Regs [SP_REGISTER]-- ; // decrement the stack pointer
-			Memory [ Regs [SP_REGISTER] ] = Regs [PCR_REGISTER]; // store return
-			Regs [PCR_REGISTER] = address ; // transfer to address
-			return 0; // return OK to bypasss PCR increment
+		Command(inbuf);
+	} while (!finish);
+	
+	printf("Good day \n");
+	return 0; // return success
+
+};
+
+// Console method to run a command script, stops at the first error
+int Console::Script(FILE *input)
+{
+	char inbuf[LINE_SIZE] ; // input buffer
+	while (!finish && fgets(inbuf,LINE_SIZE,input) != NULL) {
+		if (inbuf[0] == '#') { // comment line
+			continue;
 		}
-		default: { // instruction not implemented
-			return INSTRUCTION_INVALID ;
+		if (Command(inbuf) != 0) {
+			return EXIT_COMMAND_ERROR;
 		}
-
 	}
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
 	return 0;
 }
 
-// CPU method to handle X6 != 0 (Immediate instructions)
-int CPU::ProcessX6(int32_t instruction) {
+// Console method to execute a single command line, returns 0 if good
+int Console::Command(char *inbuf)
+{
+	char argv [MAX_ARGS][MAX_ARG_SIZE] ; //parsed command
+	int num_args ;  // number of arguments on command including command
 
+	num_args = getarg(inbuf, argv) ; // parse line
+	if (num_args < 0) {
+		return Error("Argument too long", argv[0]);
+	}
 
-//	printf ("Instruction decoded as X6 %08X instruction \n",instruction);
+// empty buffer		
+	if (num_args == 0 ) {  // buffer was empty, do nothing
+	} 
+	
+// "q" quit command
+	else if (strcmp(argv[0],"q") == 0 ) { // quit command
+		finish = true;
+	}
 
-	int code = (instruction >> 24) & 0x0000000F ;// get op code
-//	printf("Hex code X6 is %01X \n",code);
+// "xr" examine register command
+	else if (strcmp(argv[0],"xr") == 0){  //examine register command
 
-	int dest_reg = (instruction >> 20) & 0x0000000F ; // get destination
-//	printf("Destination register is %08X \n",dest_reg);
-	
-	int32_t value = instruction & 0x000FFFFF ;// immediate value from instruction
+		if (num_args > 1 ) { // register number was on command line
+			uint32_t reg_number ; 
+			if (!gethex(argv[1],&reg_number) || reg_number >= MACHINE_NUM_REGISTERS) {
+				return Error("Illegal register number", argv[1]);
+			}
+			Print_a_register(reg_number);
 
-	int32_t signed_value = value ; // first assume non negative
-	if ( (value & 0x0008000) != 0) { // short number is negative
-		signed_value = signed_value | 0xFFF ; // extend sign
-	}
-//	printf("Value is %08X \n",value);
-//	printf("Value with sign is %08X \n",signed_value) ;
-	
-	
-	// decode the instruction using a switch statement
-	switch (code) {
-		case 1: {  // load immediate
-			Regs [dest_reg] = value ;
-			break;
 		}
-		case 2: { // load immediate arithmetic
-			Regs [dest_reg] = signed_value ;
-			break;
-		}
-		case 3: { // add  immediate to register
-			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
-			Regs [dest_reg] += signed_value ;
-			break;
-		}
-		case 4: { // subract immediate from register
-			//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!!
-			Regs [dest_reg] -= signed_value ;
-			break;
-		}
-		case 5: { // OR immediate
-			Regs [dest_reg] = Regs [dest_reg] | value;
-			return 0; // return OK to bypass PCR increment
-			break;
-		
-		}
-		case 6: { // AND immediate
-			Regs [dest_reg] = Regs [dest_reg] & value ;
-			break;
-		}
-		case 7: { // XOR immediate
-			Regs [dest_reg] = Regs [dest_reg] ^ value;	
-			break;
-		}		
-		default: { // instruction not implemented
-			return INSTRUCTION_INVALID ;
+
+		else {  // none on command line, get it from  user			
+			int reg_number = Get_register_number() ;
+			if (reg_number < 0) {
+				return Error("Missing register number", argv[0]);
+			}
+			Print_a_register(reg_number);
+			
 		}
 
 	}
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}
-
-// CPU method to handle X5 != 0 (Shift instructions)
-int CPU::ProcessX5(int32_t instruction) {
 
+// "xra" examine all registers command
+	else if (strcmp(argv[0],"xra") == 0){ // examine all registers
+		Print_all_registers();
+	}	
 
-//	printf ("Instruction decoded as X5 type instruction is %08X \n",instruction);
-
-	int code = (instruction >> 20) & 0x0000000F ;// get op code
-//	printf("Hex code X5 is %01X \n",code);
+// "help"  help command
+	else if (strcmp(argv[0],"help") == 0){ // print help list
+		printf("CONS>List of all commands \n");
+		printf("help - prints this list \n");
+		printf("xr - examine register, then prompts for register number in hex \n");
+		printf("xra - examine all registersxra - prints all register \n");
+		printf("dr - deposit in register, prompt for register and contents \n");
+		printf("xm - examine memory, prompt location and number of locs in hex \n");
+		printf("dm - deposit memory,prompt location terminate input with cntrl  \n");
+		printf("     dm address value value ... deposits consecutive words \n");
+		printf("fill - fill memory, address count value in hex \n");
+		printf("load - load raw binary image file, optional hex address \n");
+		printf("loadhex - load file of hex words, optional hex address \n");
+		printf("save - save memory to raw binary file, address and count in hex \n");
+		printf("s - step a single instruction \n");
+		printf("run - run until stopped, optional instruction limit in hex \n");
+		printf("b - set breakpoint at hex address, bc clears it \n");
+		printf("w - set watchpoint at hex address, optional r, w or rw, wc clears it \n");
+		printf("bl - list breakpoints and watchpoints \n");
+		printf("smp - set number of cores sharing memory, run then runs them all \n");
+		printf("core - select the core xr, dr and s work on \n");
+		printf("stats - show counters and speed, 'stats reset' zeroes them \n");
+		printf("fuzz - fuzz the console input, workers runs [budget seedfile crashprefix] in hex \n");
+		printf("record - record console input to a log file, 'record stop' finishes it \n");
+		printf("replay - feed console input from a log file, 'replay stop' checks the result \n");
+		printf("hash - print a hash of memory and registers \n");
+		printf("telemetry - publish counters for machine-top, optional label and segment, 'telemetry off' stops \n");
+		printf("pipe - run image files as a pipeline, port 1 of each sends to port 0 of the next \n");
+		printf("cost - estimate cycles, optional cost file, 'cost report [n]' lists the top n, 'cost off' stops \n");
+		printf("test - run the test routine \n");
+		printf("attach - attach block device file, optional size in hex sectors \n");
+		printf("detach - write back and detach the block device file \n");
+		printf("q - quit \n");
+	}
 
-	int dest_reg = (instruction >> 16) & 0x0000000F ; // get destination
-//	printf("Destination register is 08X \n",dest_reg);
-	
-	int shift_count = instruction & 0x0000001F ;// shift count
-//	printf("Shift count is %08X \n",shift_count);
+// "dr"  deposit in register command
+	else if (strcmp(argv[0],"dr") == 0){ // deposit a value in a register
 
-	
-	// decode the instruction using a switch statement
-	switch (code) { 
-		case 1: {  // Shift left logical
-			Regs[dest_reg] = Regs[dest_reg] << shift_count ;
-			break;
+		int reg_number ;
+		uint32_t value ; // value to enter in register
+		
+		if (num_args > 1 ) { // register number was on command line
+			uint32_t parsed ;
+			reg_number = gethex(argv[1],&parsed) && parsed < MACHINE_NUM_REGISTERS ?
+			  (int) parsed : -1 ;
 		}
-		case 2: { // Shift right logical
-			Regs[dest_reg] = Regs[dest_reg] >> shift_count ;			
-			break;
+		else { // register not on command line, get it from user
+			reg_number = Get_register_number() ;
+		}
+		if ( (reg_number < 0) || (reg_number >= MACHINE_NUM_REGISTERS)) {
+			return Error("Illegal register number", num_args > 1 ? argv[1] : argv[0]);
 		}
-		case 3: { // Shift left arithmetic
-
-			int cnt = 0 ; // counts how many we have done
-			int32_t initial_sign = Regs[dest_reg] & 0x80000000 ;
-			
-			while (cnt < shift_count) {
 
-				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
-				Regs[dest_reg] = Regs[dest_reg] << 1 ; // do the shift
-				//!!!!!!!!!!!!!!!! needs overflow check !!!!!!!!!!!!!!!!
-			
-				cnt++; // increment counter ;
+		if (num_args > 2) { // value was also on command line
+			if (!gethex(argv[2],&value)) { // decode value
+				return Error("Illegal value", argv[2]);
 			}
-			break;
 		}
-		
-		case 4: { // Shift right arithmetic
-			int cnt = 0 ; // counts how many we have done
+		else { // value not on command line, get it from user
 			
-			while (cnt < shift_count) {
-
-				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
-				Regs[dest_reg] = Regs[dest_reg] >>  1 ; // do the shift
-				if (sign == 0x80000000) { // if number was negative
-					Regs[dest_reg] = Regs[dest_reg] | 0x80000000; //extend sign
-				}
-				cnt++; // increment counter ;
-			}			
-
-			break;
+			char line[LINE_SIZE] ;
+			if (!Ask("CONS?>enter value to deposit in hex ",line,LINE_SIZE)) {
+				return Error("Missing value", argv[0]);
+			}
+			if (!gethex(line,&value)) {
+				return Error("Illegal value", line);
+			}
 		}
-		case 5: { // Shift left circular
-			int cnt = 0 ; // counts how many we have done
-			while (cnt < shift_count) {
+		machine_set_register( vm, reg_number, (int32_t) value );  // store the value 
+	}
 
-				int sign = Regs[dest_reg] & 0x80000000 ;// isolate sign
-				Regs[dest_reg] = Regs[dest_reg] << 1 ; // do the shift
-				if (sign == 0x80000000) { // set low bit if sign set
-					Regs[dest_reg] = Regs[dest_reg] | 0x000000001 ;
-				}
-				cnt++; // increment counter ;
-			}	
-				
-					
-			break;
+// "xm" examine memory command
+	else if (strcmp(argv[0],"xm") == 0){  // examine memory
+		uint32_t address;
+		uint32_t number_words;
+		char line[LINE_SIZE] ;
+		
+		if (num_args > 1 ) { // memory address was on command line
+			if (!gethex(argv[1],&address)) {
+				return Error("Illegal address", argv[1]);
+			}
+		}			
 		
+		else { // address not on command line, get it 
+			if (!Ask("CONS?>enter in hex memory location> ",line,LINE_SIZE)) {
+				return Error("Missing address", argv[0]);
+			}
+			if (!gethex(line,&address)) {
+				return Error("Illegal address", line);
+			}
+			printf("\n");
 		}
-		case 6: { // Shift right circular
-			int cnt = 0 ; // counts how many we have done
-			while (cnt < shift_count) {
 
-				int lsb = Regs[dest_reg] & 0x00000001 ;// isolate lsb
-				Regs[dest_reg] = Regs[dest_reg] >> 1 ; // do the shift
-				if (lsb == 0x00000001) { // set sign bit if lsb set
-					Regs[dest_reg] = Regs[dest_reg] | 0x80000000 ;
-				}
-				
-				cnt++; // increment counter ;
-			}	
-			break;
+		if (num_args > 2) { // word count was also on the initial command
+			if (!gethex(argv[2],&number_words)) {
+				return Error("Illegal word count", argv[2]);
+			}
 		}
-	
-		default: { // instruction not implemented
-			return INSTRUCTION_INVALID ;
+		else { // no word count was entered
+			if (!Ask("CONS?>enter number of words in hex> ",line,LINE_SIZE)) {
+				return Error("Missing word count", argv[0]);
+			}
+			if (!gethex(line,&number_words)) {
+				return Error("Illegal word count", line);
+			}
 		}
+			
 
+		for (uint32_t i = 0; i < number_words; i++){ // do the dump
+			if (Print_memory_location(address) != 0) {
+				char where[16] ;
+				snprintf(where,sizeof(where),"%08X",address) ;
+				return Error("Illegal memory address", where);
+			}
+			address++;
+		}
 	}
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}
-
-// CPU method to handle X4 != 0 (Register to register instructions)
-int CPU::ProcessX4(int32_t instruction) {
-
-//	printf ("Instruction decoded as X4 type instruction is %08X \n",instruction);
-
-	int code = (instruction >> 16) & 0x0000000F ;// get op code
-//	printf("Hex code X4 is %01X \n",code);
 
-	int dest_reg = (instruction >> 8) & 0x0000000F ; // get destination
-//	printf("Destination register is 08X \n",dest_reg);
-	
-	int src_reg = instruction  & 0x0000000F ; // get source register
-//	printf("Destination register is 08X \n",dest_reg);	
-	
-	// decode the instruction using a switch statement
-	switch (code) { 
-
-		case 1: {  // Copy register
-			Regs[dest_reg] = Regs[src_reg] ; // do the copy
-			break ;
-		}
-		
-		case 2: { // Add register
-			Regs[dest_reg] += Regs[src_reg] ; // do the add
-			//!!!!!!!!!!!!!!!!! need overflow check !!!!!!!!!!!!
-			break; 
-		}
-		
-		case 3: { // Subtract register
-			Regs[dest_reg] -= Regs[src_reg] ; // do the subtract
-			//!!!!!!!!!!!!!!!!! need overflow check !!!!!!!!!!!!
-			break;
-		}
-		
-		case 4: { // 'OR' registers
-			Regs[dest_reg] = Regs[src_reg] | Regs[dest_reg] ;
-			break;
-		}
-		
-		case 5: { // 'AND' registers
-			Regs[dest_reg] = Regs[src_reg] & Regs[dest_reg] ;
-			break;			
-		}
-		
-		case 6: { // 'XOR' registers
-			Regs[dest_reg] = Regs[src_reg] ^ Regs[dest_reg] ;
-			break;
-		}
+// "dm" deposit memory command
+	else if (strcmp(argv[0],"dm") == 0) { // deposit memory
+		uint32_t address;
+		uint32_t value;
+		char inbuf[21];
+		char* pointer_string;
 		
-		case 7: { // skip greater
-			if (Regs[src_reg] > Regs[dest_reg]) {
-				Regs[PCR_REGISTER]++ ;
+		if (num_args > 1 ) { // memory address was on command line
+			if (!gethex(argv[1],&address)) {
+				return Error("Illegal address", argv[1]);
 			}
-			break;
-		}
-		
-		case 8: { // skip greater or equal
-			if (Regs[src_reg] >= Regs[dest_reg]) {
-				Regs[PCR_REGISTER]++ ;
-			}			
-			break;
-		}	
+		}			
 		
-		case 9: { // skip equal
-			if (Regs[src_reg] == Regs[dest_reg]) {
-				Regs[PCR_REGISTER]++ ;
-			}
-			break;
+		else { // address not on command line, get it 
+				if (!Ask("CONS> enter beginning memory address> ",inbuf,21)) {
+					return Error("Missing address", argv[0]);
+				}
+				if (!gethex(inbuf,&address)) {
+					return Error("Illegal address", inbuf);
+				}
 		}
 		
-		case 0xA: { //  skip less than or equal
-			if (Regs[src_reg] <= Regs[dest_reg]) {
-				Regs[PCR_REGISTER]++ ;
+		if (num_args > 2) { // values were also supplied, store them all
+			int32_t values[MAX_ARGS] ;
+			int count = num_args - 2 ;
+			for (int i = 0; i < count; i++) {
+				if (!gethex(argv[i + 2],&value)) {
+					return Error("Illegal value", argv[i + 2]);
+				}
+				values[i] = (int32_t) value ;
 			}
-			break;
-		}
-		
-		case 0xB: { // skip less than
-			if (Regs[src_reg] < Regs[dest_reg]) {
-				Regs[PCR_REGISTER]++ ;
+			if (machine_write_memory(vm, address, values, count) != MACHINE_OK) {
+				return Error("Illegal memory address", argv[1]);
 			}
-			break;
 		}
-		
-		case 0xC: { // skip on overflow
-			if (Regs[STATUS_REGISTER] & OVERFLOW_BIT) {
-				Regs[PCR_REGISTER]++ ;
-			}
-			break;
+		else if (scripted) {
+			return Error("Missing values", argv[0]);
 		}
+		else { // need a series of values
 		
+			printf("CONS> enter consecutive memory values, break with return only \n");
+			printf("CONS %08X contents? > ",address);
+			
+			do {
 
-		case 0xD: { // skip no overflow
-
+				pointer_string=fgets( inbuf,21,stdin);
+//					printf("String length is %d \n",strlen(pointer_string));
+				if (pointer_string != NULL && strlen(pointer_string) >1){
+					if (!gethex(pointer_string,&value)) {
+						printf("Illegal value \n");
+					}
+					else if (machine_write_memory(vm, address, (int32_t *) &value, 1) != MACHINE_OK) {
+						return Error("Illegal memory address", argv[0]);
+					}
+					else {
+						address++;
+					}
+					printf("CONS %08X contents? > ",address);
+
+				}	
 			
-			break;
+			} while ( (pointer_string != NULL) && (strlen(pointer_string) > 1) );
+			// deposit loop terminates on empty line of return only or cntrl/d 
+		}	
+	} // end of "dm" hander
+
+// "fill" fill memory command
+	else if (strcmp(argv[0],"fill") == 0) { // fill a range of memory
+		uint32_t address ;
+		uint32_t count ;
+		uint32_t value ;
+		if (num_args < 4 || !gethex(argv[1],&address) || !gethex(argv[2],&count) ||
+		  !gethex(argv[3],&value)) {
+			return Error("Usage: fill address count value", argv[0]);
 		}
-		
-		default: { // instruction not implemented
-			return INSTRUCTION_INVALID ;
+		if (address > MACHINE_MEMORY_SIZE || count > MACHINE_MEMORY_SIZE - address) {
+			return Error("Illegal memory range", argv[1]);
 		}
+		static int32_t words[MACHINE_MEMORY_SIZE] ;
+		for (uint32_t i = 0; i < count; i++) {
+			words[i] = (int32_t) value ;
+		}
+		machine_write_memory(vm, address, words, count);
+	}
 
+// "load" raw binary image command
+	else if (strcmp(argv[0],"load") == 0) { // load an image file
+		uint32_t address = 0 ;
+		if (num_args < 2) {
+			return Error("Usage: load file [address]", argv[0]);
+		}
+		if (num_args > 2 && !gethex(argv[2],&address)) {
+			return Error("Illegal address", argv[2]);
+		}
+		if (machine_load_image(vm, argv[1], address) != MACHINE_OK) {
+			return Error("Unable to load", argv[1]);
+		}
 	}
-			
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}	
 
-// CPU method to handle X3 != 0 (Single Register Instructions)
-int CPU::ProcessX3(int32_t instruction) {
-//	printf ("Instruction decoded as X3 type instruction is %08X \n",instruction);
+// "loadhex" hex text file command
+	else if (strcmp(argv[0],"loadhex") == 0) { // load a hex file
+		uint32_t address = 0 ;
+		if (num_args < 2) {
+			return Error("Usage: loadhex file [address]", argv[0]);
+		}
+		if (num_args > 2 && !gethex(argv[2],&address)) {
+			return Error("Illegal address", argv[2]);
+		}
+		if (Load_hex(argv[1], address) != 0) {
+			return Error("Unable to load", argv[1]);
+		}
+	}
 
-	int code = (instruction >> 12) & 0x0000000F ;// get op code
-//	printf("Hex code X2 is %01X \n",code);
-	
-	int reg = instruction & 0x0000000F ; // get register
-//  printf("Register is %08X \n",reg);
+// "save" raw binary image command
+	else if (strcmp(argv[0],"save") == 0) { // save memory to a file
+		uint32_t address ;
+		uint32_t count ;
+		if (num_args < 4 || !gethex(argv[2],&address) || !gethex(argv[3],&count)) {
+			return Error("Usage: save file address count", argv[0]);
+		}
+		if (Save_image(argv[1], address, count) != 0) {
+			return Error("Unable to save", argv[1]);
+		}
+	}
 	
-	// decode the instruction using a switch statement
-	switch (code) { 
+// "s" single instruction step command
+	else if (strcmp(argv[0],"s") == 0){ // step an instruction
+		int32_t address = machine_get_register(vm, MACHINE_PC_REGISTER) ;
+		int32_t instruction = 0 ;
+		machine_read_memory(vm, address, &instruction, 1) ;
+		if (!scripted) {
+			printf("CONS> Step -instruction at %08X is %08X \n",address,instruction);
+		}
+		int status = machine_step(vm);
+		if (status == MACHINE_WATCHPOINT || status == MACHINE_BREAKPOINT) {
+			Report_stop(status, 1);
+		}
+	}
 
-		case 1: {  // clear register
-			Regs[reg] = 0 ;
-			break;
+// "run" run until stopped command
+	else if (strcmp(argv[0],"run") == 0) { // run the machine
+		unsigned long long limit = 0 ;
+		uint64_t executed ;
+		if (num_args > 1 && // instruction limit on the command line
+		  sscanf(argv[1],"%llx",&limit) != 1) {
+			return Error("Illegal instruction limit", argv[1]);
 		}
-		
-		case 2: { // invert register
-			Regs[reg] ^ 0xFFFFFFFF ;
-			break;
+		if (machine_get_cores(vm) > 1) { // all cores, each on its own thread
+			Run_smp(limit);
 		}
-		
-		case 3: { // complement register
-			if (Regs[reg] == 0x80000000) { // check for overflow
-				Regs[0] = Regs[0] | 0x00000001 ; // set overflow bit
-				Regs[0] = 0x7FFFFFF ; // set to max positive allowed
-				break;
-			}
-			else {
-				Regs[0] = Regs[0] & 0xFFFFFFFE ; // clear overflow
+		else {
+			run_status = machine_run(vm, limit, &executed) ;
+			ran = true ;
+			Report_stop(run_status, executed);
+		}
+	}
+
+// "smp" set number of cores command
+	else if (strcmp(argv[0],"smp") == 0) { // set the number of cores
+		uint32_t cores ;
+		if (num_args < 2) {
+			if (!scripted) {
+				printf("CONS> %d cores \n",machine_get_cores(vm));
 			}
-			
-			Regs[reg] = -Regs[reg]; // no overflow, normal complement
-			break;
+			return 0;
 		}
-		
-		case 4: { // Push register
-			Regs[SP_REGISTER]-- ; // decrement stack pointer
-			Memory[ Regs[SP_REGISTER] ] = Regs[reg] ; // push register
-			break;
+		if (!gethex(argv[1],&cores) || cores > MACHINE_MAX_CORES ||
+		  machine_set_cores(vm, (int) cores) != MACHINE_OK) {
+			return Error("Illegal number of cores", argv[1]);
 		}
-		
-		case 5: { // Pop register
-			Regs[reg] = Memory[ Regs[SP_REGISTER] ] ; // pop register
-			Regs[SP_REGISTER]++ ; // increment stack pointer
-			break;
+		current_core = 0 ;
+	}
+
+// "core" select core command
+	else if (strcmp(argv[0],"core") == 0) { // select core for xr, dr, s
+		uint32_t core ;
+		if (num_args < 2) {
+			return Error("Usage: core number", argv[0]);
 		}
-		
-		default: { // invalid instruction
-			return INSTRUCTION_INVALID ;
+		if (!gethex(argv[1],&core) || core >= MACHINE_MAX_CORES ||
+		  machine_select_core(vm, (int) core) != MACHINE_OK) {
+			return Error("Illegal core number", argv[1]);
 		}
-		
-	} // end of switch decode	
-	
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}
-	
-// CPU method to handle X2 != 0 (I/O instructions)
-int CPU::ProcessX2(int32_t instruction) {	
-	
-	
-//	printf ("Instruction decoded as X2 type instruction is %08X \n",instruction);
-
-	int code = (instruction >> 8) & 0x0000000F ;// get op code
-//	printf("Hex code X2 is %01X \n",code);
-	
-	int ioreg = instruction & 0x0000000F ; // get register
-//  printf("IO register is %08X \n",ioreg);
-	
-	// decode the instruction using a switch statement
-	switch (code) { 
+		current_core = core ;
+	}
 
-		case 1: {  // Write character
-			int c = Regs[ioreg] & 0xFF ; // isolate low byte
-			putchar(c); // output the character
-			break ;
-		}	
-		
-		case 2: { // Read character
-			int c ;
-			c = getchar() ; // get a character
-			Regs[ioreg] = (Regs[ioreg] & 0xFFFFFF00) | (c & 0xFF) ;
-			break ;			
-		}
-		
-		case 3: { // Write register contents line
-			printf("Reg %1x = %08x \n",ioreg,Regs[ioreg]) ;
-			break ;
+// "b" set breakpoint command
+	else if (strcmp(argv[0],"b") == 0) { // set a breakpoint
+		uint32_t address ;
+		if (num_args < 2) {
+			return Error("Usage: b address", argv[0]);
 		}
-		
-		default: { // instruction not implemented
-			return INSTRUCTION_INVALID ;
+		if (!gethex(argv[1],&address) ||
+		  machine_set_breakpoint(vm, address) != MACHINE_OK) {
+			return Error("Unable to set breakpoint", argv[1]);
 		}
+	}
 
-	} // end of switch decode
-			
-	Regs[PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}			
+// "bc" clear breakpoint command
+	else if (strcmp(argv[0],"bc") == 0) { // clear a breakpoint
+		uint32_t address ;
+		if (num_args < 2) {
+			return Error("Usage: bc address", argv[0]);
+		}
+		if (!gethex(argv[1],&address) ||
+		  machine_clear_breakpoint(vm, address) != MACHINE_OK) {
+			return Error("No breakpoint at", argv[1]);
+		}
+	}
 
-// CPU method to handle X1 != 0 (Misc instructions)
-int CPU::ProcessX1(int32_t instruction) {	
+// "w" set watchpoint command
+	else if (strcmp(argv[0],"w") == 0) { // set a watchpoint
+		uint32_t address ;
+		int type = MACHINE_WATCH_READ | MACHINE_WATCH_WRITE ;
+		if (num_args < 2) {
+			return Error("Usage: w address [r|w|rw]", argv[0]);
+		}
+		if (!gethex(argv[1],&address)) {
+			return Error("Illegal address", argv[1]);
+		}
+		if (num_args > 2) { // type was on the command line
+			type = 0 ;
+			if (strchr(argv[2],'r') != NULL) {
+				type |= MACHINE_WATCH_READ ;
+			}
+			if (strchr(argv[2],'w') != NULL) {
+				type |= MACHINE_WATCH_WRITE ;
+			}
+		}
+		if (machine_set_watchpoint(vm, address, type) != MACHINE_OK) {
+			return Error("Unable to set watchpoint", argv[1]);
+		}
+	}
 
+// "wc" clear watchpoint command
+	else if (strcmp(argv[0],"wc") == 0) { // clear a watchpoint
+		uint32_t address ;
+		if (num_args < 2) {
+			return Error("Usage: wc address", argv[0]);
+		}
+		if (!gethex(argv[1],&address) ||
+		  machine_clear_watchpoint(vm, address) != MACHINE_OK) {
+			return Error("No watchpoint at", argv[1]);
+		}
+	}
 
-//	printf ("Instruction decoded as X1 type instruction is %08X \n",instruction);
+// "bl" list breakpoints and watchpoints command
+	else if (strcmp(argv[0],"bl") == 0) { // list them all
+		uint32_t addresses[MACHINE_MAX_BREAKPOINTS + MACHINE_MAX_WATCHPOINTS] ;
+		int types[MACHINE_MAX_WATCHPOINTS] ;
+		int count = machine_get_breakpoints(vm, addresses) ;
+		for (int i = 0; i < count; i++) {
+			printf(scripted ? "b %08X\n" : "CONS> Breakpoint %08X \n",addresses[i]);
+		}
+		count = machine_get_watchpoints(vm, addresses, types) ;
+		for (int i = 0; i < count; i++) {
+			printf(scripted ? "w %08X %s\n" : "CONS> Watchpoint %08X %s \n",
+			  addresses[i], Watch_name(types[i]));
+		}
+	}
 
-	int code = (instruction >> 4) & 0x0000000F ;// get op code
-//	printf("Hex code X1 is %01X \n",code);
+// "stats" performance counters command
+	else if (strcmp(argv[0],"stats") == 0) { // show the counters
+		if (num_args > 1 && strcmp(argv[1],"reset") == 0) {
+			machine_reset_stats(vm);
+		}
+		else {
+			Print_stats();
+		}
+	}
 
-	// decode the instruction using a switch statement
-	switch (code) { 
+// "fuzz" coverage guided fuzzing command
+	else if (strcmp(argv[0],"fuzz") == 0) { // fuzz the console input
+		return Fuzz(num_args, argv);
+	}
 
-		case 1: {  // No op
+// "record" and "replay" console input log commands
+	else if (strcmp(argv[0],"record") == 0 || strcmp(argv[0],"replay") == 0) {
+		if (num_args < 2) {
+			return Error("Usage: record|replay file, or record|replay stop", argv[0]);
+		}
+		if (strcmp(argv[1],"stop") == 0) {
+			return Log_stop(argv[0]);
+		}
+		int status = strcmp(argv[0],"record") == 0 ?
+		  machine_record(vm, argv[1]) : machine_replay(vm, argv[1]) ;
+		if (status != MACHINE_OK) {
+			return Error("Unable to start log", argv[1]);
+		}
+	}
 
-			break ;
-		}	
-		
-		case 2: { // call return
+// "hash" machine state hash command
+	else if (strcmp(argv[0],"hash") == 0) { // hash memory and registers
+		printf(scripted ? "%016llX\n" : "CONS> State hash %016llX \n",
+		  (unsigned long long) machine_state_hash(vm));
+	}
 
-			Regs[PCR_REGISTER] = Memory[Regs[SP_REGISTER]]  ; // go back via stack
-			Regs[SP_REGISTER]++ ; // bump the stack
-			return 0 ; // bypass PCR increment
+// "telemetry" shared memory counters command
+	else if (strcmp(argv[0],"telemetry") == 0) { // publish for machine-top
+		if (num_args > 1 && strcmp(argv[1],"off") == 0) {
+			machine_telemetry_detach(vm);
 		}
-	
-		default: {
-			return INSTRUCTION_INVALID ;
+		else {
+			int slot = machine_telemetry_attach(vm, num_args > 2 ? argv[2] : NULL,
+			  num_args > 1 ? argv[1] : NULL);
+			if (slot < 0) {
+				return Error("Unable to publish telemetry",
+				  num_args > 2 ? argv[2] : "default segment");
+			}
+			if (!scripted) {
+				printf("CONS> Publishing telemetry in slot %d \n",slot);
+			}
 		}
-	} // end of decode switch
-
-	Regs [PCR_REGISTER]++ ; // increment the program counter			
-	return 0;
-}	
-// CPU method for tests, called by console with 'test' command
+	}
 
-int CPU::Test(void) { // test code goes here, called by 'test' from console
-	printf("Test routine entered \n") ;
-}
+// "cost" cycle cost model command
+	else if (strcmp(argv[0],"cost") == 0) { // estimate cycles on the selected core
+		if (num_args > 1 && strcmp(argv[1],"off") == 0) {
+			machine_cost_disable(vm);
+		}
+		else if (num_args > 1 && strcmp(argv[1],"report") == 0) {
+			int count = 10 ;
+			if (num_args > 2 && sscanf(argv[2],"%d",&count) != 1) {
+				return Error("Illegal count", argv[2]);
+			}
+			return Print_costs(count);
+		}
+		else if (machine_cost_enable(vm, num_args > 1 ? argv[1] : NULL) != MACHINE_OK) {
+			return Error("Unable to load costs", num_args > 1 ? argv[1] : "built in");
+		}
+	}
 
+// "pipe" channel pipeline command
+	else if (strcmp(argv[0],"pipe") == 0) { // run a pipeline of machines
+		return Pipe(num_args, argv);
+	}
 
+// "test" execute test code command
+	else if (strcmp(argv[0],"test") == 0) { //execute test routine
+		machine_test(vm);
+	}
 
-// ******************************************************************
-// Console support routines
-// ******************************************************************  
-// getarg function parses buffer into arguments, returning number
-// of arguments.
-#define MAX_ARGS 10 
-#define MAX_ARG_SIZE 80 
-int getarg(char *buffer, char argv[][MAX_ARG_SIZE]) {
+// "attach" block device command
+	else if (strcmp(argv[0],"attach") == 0) { // attach a host file
+		if (num_args > 1) {
+			uint32_t sectors = 0 ;
+			if (num_args > 2 && // size was also on the command line
+			  (!gethex(argv[2],&sectors) || sectors > 0x7FFFFFFF)) {
+				return Error("Illegal sector count", argv[2]);
+			}
+			if (machine_attach_disk(vm, argv[1], (int32_t) sectors) != MACHINE_OK) {
+				return Error("Unable to attach", argv[1]);
+			}
+		}
+		if (!scripted) {
+			if (machine_disk_sectors(vm) != 0) {
+				printf("CONS> Block device %s, %X sectors \n",
+				  machine_disk_path(vm), machine_disk_sectors(vm));
+			}
+			else {
+				printf("CONS> No block device attached \n");
+			}
+		}
+	}
 
-	int arg_count = 0 ;
-	char* ptr_string ;
+// "detach" block device command
+	else if (strcmp(argv[0],"detach") == 0) { // release the host file
+		machine_detach_disk(vm);
+	}
 
-	ptr_string = strtok(buffer, " \n");
-	while (ptr_string != NULL) {
+// 
+	else {
+		return Error("Command not found", argv[0]);
+	}
 
+	return 0;
+}
 
-//		printf(" %d %s\n",arg_count,ptr_string);
-		strcpy(&argv[arg_count][0],ptr_string) ;
-		arg_count++ ;
-		ptr_string = strtok (NULL," \t\n");
+// Console method to prompt for a missing argument, scripts can't answer
+bool Console::Ask(const char *prompt, char *inbuf, int size)
+{
+	if (scripted) {
+		return false;
 	}
-	return arg_count ;
+	printf("%s",prompt);
+	return fgets(inbuf,size,stdin) != NULL;
 }
-/************************************************************
- * Console Class
- * **********************************************************/
-class Console
-{
-	public:
-		Console() ; // Console constructor
-		int Start();		// Console runs until terminated
 
-	private:
-		CPU cpu ; // CPU object
-		void Print_a_register(int regnum);
-		void Print_all_registers(void);
-		int Get_register_number();
-		void Print_memory_location(int address);
-		
-}; // end of Console class definition
-
-Console::Console() {   //Console constructor
+// Console method to report a failed command, returns the error status
+int Console::Error(const char *message, const char *detail)
+{
+	if (scripted) {
+		fprintf(stderr,"machine: %s: %s\n",message,detail);
+	}
+	else {
+		printf("%s \n",message);
+	}
+	return EXIT_COMMAND_ERROR;
 }
 
-// Mainline console method to run the console
-int Console::Start()
+// Console method to say why a run stopped
+void Console::Report_stop(int status, uint64_t executed)
 {
-	char inbuf[81] ; // input buffer
-	char argv [MAX_ARGS][MAX_ARG_SIZE] ; //parsed command
-	int num_args ;  // number of arguments on command including command
-	bool finish = false;
-	do {
-		printf("CONS?> ");
-		fgets( inbuf,81,stdin);
-		num_args = getarg(inbuf, argv) ; // parse line
+	int32_t pc = machine_get_register(vm, MACHINE_PC_REGISTER) ;
+	uint32_t watch_address = 0 ;
+	int watch_type = 0 ;
+	if (status == MACHINE_WATCHPOINT) {
+		machine_watch_hit(vm, &watch_address, &watch_type) ;
+	}
 
-// empty buffer		
-		if (num_args == 0 ) {  // buffer was empty, do nothing
-		} 
-		
-// "q" quit command
-		else if (strcmp(argv[0],"q") == 0 ) { // quit command
-			finish = true;
-			break;
+	if (scripted) {
+		printf("run %d %08X %llu",status,pc,(unsigned long long) executed);
+		if (status == MACHINE_WATCHPOINT) {
+			printf(" %08X %s",watch_address,Watch_name(watch_type));
 		}
+		printf("\n");
+	}
+	else if (status == MACHINE_BREAKPOINT) {
+		printf("CONS> Breakpoint at %08X after %llu instructions \n",
+		  pc,(unsigned long long) executed);
+	}
+	else if (status == MACHINE_WATCHPOINT) {
+		printf("CONS> Watchpoint %08X %s, stopped at %08X after %llu instructions \n",
+		  watch_address,watch_type == MACHINE_WATCH_READ ? "read" : "written",
+		  pc,(unsigned long long) executed);
+	}
+	else {
+		printf("CONS> Stopped at %08X status %d after %llu instructions \n",
+		  pc,status,(unsigned long long) executed);
+	}
+}
 
-// "xr" examine register command
-		else if (strcmp(argv[0],"xr") == 0){  //examine register command
-
-			if (num_args > 1 ) { // register number was on command line
-				int reg_number ; 
-				sscanf(argv[1],"%x",&reg_number);
-				Print_a_register(reg_number);
-
-			}
+// Console method to print the statistics since the last reset
+void Console::Print_stats(void)
+{
+	machine_stats_t stats ;
+	machine_get_stats(vm, &stats) ;
+	double mips = stats.run_seconds > 0 ?
+	  stats.instructions / stats.run_seconds / 1e6 : 0 ;
+	const char *format = scripted ? "%s %llu\n" : "CONS> %-16s %llu \n" ;
+
+	printf(format,"instructions",(unsigned long long) stats.instructions);
+	printf(format,"branches",(unsigned long long) stats.branches);
+	printf(format,"calls",(unsigned long long) stats.calls);
+	printf(format,"loads",(unsigned long long) stats.loads);
+	printf(format,"stores",(unsigned long long) stats.stores);
+	printf(format,"io",(unsigned long long) stats.io_operations);
+	printf(format,"chars_in",(unsigned long long) stats.chars_in);
+	printf(format,"chars_out",(unsigned long long) stats.chars_out);
+	printf(format,"sectors_read",(unsigned long long) stats.sectors_read);
+	printf(format,"sectors_written",(unsigned long long) stats.sectors_written);
+	format = scripted ? "%s %.6f\n" : "CONS> %-16s %.6f \n" ;
+	printf(format,"run_seconds",stats.run_seconds);
+	printf(format,"wall_seconds",stats.wall_seconds);
+	printf(format,"mips",mips);
+}
 
-			else {  // none on command line, get it from  user			
-				Print_a_register(Get_register_number());
-				
-			}
+// Console method to list the total cycles and the costliest functions
+// and blocks, count of each
+int Console::Print_costs(int count)
+{
+	if (count < 1) {
+		count = 1 ;
+	}
+	if (count > MACHINE_MEMORY_SIZE) { // no more entries than addresses
+		count = MACHINE_MEMORY_SIZE ;
+	}
+	machine_cost_entry_t *entries = new (std::nothrow) machine_cost_entry_t[count] ;
+	if (entries == NULL) {
+		return Error("Unable to report costs", "out of memory");
+	}
+	printf(scripted ? "cycles %llu\n" : "CONS> Cycles %llu \n",
+	  (unsigned long long) machine_cost_cycles(vm));
+	int listed = machine_cost_functions(vm, entries, count) ;
+	for (int i = 0; i < listed; i++) {
+		printf(scripted ? "function %08X %llu %llu\n" :
+		  "CONS> Function %08X %8llu calls %12llu cycles \n",
+		  entries[i].address,(unsigned long long) entries[i].count,
+		  (unsigned long long) entries[i].cycles);
+	}
+	listed = machine_cost_blocks(vm, entries, count) ;
+	for (int i = 0; i < listed; i++) {
+		printf(scripted ? "block %08X %llu %llu\n" :
+		  "CONS> Block    %08X %8llu runs  %12llu cycles \n",
+		  entries[i].address,(unsigned long long) entries[i].count,
+		  (unsigned long long) entries[i].cycles);
+	}
+	delete[] entries;
+	return 0;
+}
 
+// Console method to fuzz the loaded program from its current state,
+// crash inputs are saved as <prefix><n>.bin if a prefix is given
+int Console::Fuzz(int num_args, char argv[MAX_ARGS][MAX_ARG_SIZE])
+{
+	static machine_fuzz_result_t result ; // too big for the stack
+	static uint8_t seed[MACHINE_FUZZ_MAX_INPUT] ;
+	machine_fuzz_options_t options ;
+	unsigned int workers = 1 ;
+	unsigned long long executions = 0 ;
+	unsigned long long budget = 0x10000 ;
+
+	if (num_args < 3) {
+		return Error("Usage: fuzz workers runs [budget] [seedfile] [crashprefix]", argv[0]);
+	}
+	if (sscanf(argv[1],"%x",&workers) != 1 || sscanf(argv[2],"%llx",&executions) != 1 ||
+	  (num_args > 3 && sscanf(argv[3],"%llx",&budget) != 1)) {
+		return Error("Usage: fuzz workers runs [budget] [seedfile] [crashprefix]", argv[0]);
+	}
+	memset(&options, 0, sizeof(options)) ;
+	options.workers = workers ;
+	options.executions = executions ;
+	options.budget = budget ;
+	if (num_args > 4 && strcmp(argv[4],"-") != 0) { // "-" for no seed
+		FILE *file = fopen(argv[4],"rb") ;
+		if (file == NULL) {
+			return Error("Unable to open", argv[4]);
 		}
+		options.seed_length = fread(seed, 1, sizeof(seed), file) ;
+		options.seed = seed ;
+		fclose(file) ;
+	}
 
-// "xra" examine all registers command
-		else if (strcmp(argv[0],"xra") == 0){ // examine all registers
-			Print_all_registers();
-		}	
+	if (machine_fuzz(vm, &options, &result) != MACHINE_OK) {
+		return Error("Unable to fuzz", argv[1]);
+	}
+	double rate = result.seconds > 0 ? result.executions / result.seconds : 0 ;
+	if (scripted) {
+		printf("fuzz %llu %zu %zu %d\n",(unsigned long long) result.executions,
+		  result.corpus,result.edges,result.num_crashes);
+	}
+	else {
+		printf("CONS> %llu runs in %.3f seconds, %.0f per second \n",
+		  (unsigned long long) result.executions,result.seconds,rate);
+		printf("CONS> %zu inputs in corpus, %zu edges, %d distinct crashes \n",
+		  result.corpus,result.edges,result.num_crashes);
+	}
 
-// "help"  help command
-		else if (strcmp(argv[0],"help") == 0){ // print help list
-			printf("CONS>List of all commands \n");
-			printf("help - prints this list \n");
-			printf("xr - examine register, then prompts for register number in hex \n");
-			printf("xra - examine all registersxra - prints all register \n");
-			printf("dr - deposit in register, prompt for register and contents \n");
-			printf("xm - examine memory, prompt location and number of locs in hex \n");
-			printf("dm - deposit memory,prompt location terminate input with cntrl  \n");
-			printf("s - step a single instruction \n");
-			printf("test - run the test routine \n");
+	for (int i = 0; i < result.num_crashes; i++) {
+		machine_fuzz_crash_t *crash = &result.crashes[i] ;
+		if (scripted) {
+			printf("crash %d %08X %llu %zu\n",crash->status,crash->pc,
+			  (unsigned long long) crash->count,crash->length);
 		}
-
-// "dr"  deposit in register command
-		else if (strcmp(argv[0],"dr") == 0){ // deposit a value in a register
-
-			int reg_number ;
-			int32_t value ; // value to enter in register
-			
-			if (num_args > 1 ) { // register number was on command line
-				sscanf(argv[1],"%x",&reg_number);
-			}
-			else { // register not on command line, get it from user
-				reg_number = Get_register_number() ;
-			}
-
-			if (num_args > 2) { // value was also on command line
-				sscanf(argv[2],"%x",&value); // decode value
-				
-			}
-			else { // value not on command line, get it from user
-				
-				printf("CONS?>enter value to deposit in hex ");
-				fgets( inbuf,81,stdin);
-				sscanf(inbuf,"%x",&value);
+		else {
+			printf("CONS> Crash status %d at %08X, seen %llu times, input %zu bytes \n",
+			  crash->status,crash->pc,(unsigned long long) crash->count,crash->length);
+		}
+		if (num_args > 5) {
+			char path[MAX_ARG_SIZE + 16] ;
+			snprintf(path,sizeof(path),"%s%d.bin",argv[5],i) ;
+			FILE *file = fopen(path,"wb") ;
+			if (file == NULL || fwrite(crash->input, 1, crash->length, file) != crash->length) {
+				if (file != NULL) {
+					fclose(file) ;
+				}
+				return Error("Unable to save", path);
 			}
-			cpu.Store_value_in_register( reg_number, value );  // store the value 
+			fclose(file) ;
 		}
+	}
+	return 0;
+}
 
-// "xm" examine memory command
-		else if (strcmp(argv[0],"xm") == 0){  // examine memory
-			int address;
-			int number_words;
-			
-			if (num_args > 1 ) { // memory address was on command line
-				sscanf(argv[1],"%x",&address);
-			}			
-			
-			else { // address not on command line, get it 
-				printf("CONS?>enter in hex memory location> ");
-				fgets(inbuf,81,stdin);
-				sscanf(inbuf,"%x ",&address) ;
-				printf("\nCONS?>enter number of words in hex> ") ;
-				fgets(inbuf,81,stdin);
-				sscanf(inbuf,"%x ",&number_words) ;
-				
-			}
+// Console method to finish recording or replaying, a replay that went
+// differently is an error so scripts can catch it
+int Console::Log_stop(const char *name)
+{
+	machine_replay_result_t result ;
+	result.matched = -1 ; // left alone if nothing was being logged
+	int status = machine_log_stop(vm, &result) ;
+	if (result.matched == -1) {
+		return Error("Not recording or replaying", name);
+	}
+	if (strcmp(name,"record") == 0) {
+		if (status != MACHINE_OK) {
+			return Error("Unable to write log", name);
+		}
+		if (!scripted) {
+			printf("CONS> Recorded %llu characters over %llu instructions, hash %016llX \n",
+			  (unsigned long long) result.events,
+			  (unsigned long long) result.instructions,
+			  (unsigned long long) result.hash);
+		}
+		return 0;
+	}
 
-			if (num_args == 2 ) { // address but no word count was entered
-				printf("CONS?>enter number of words in hex> ") ;
-				fgets(inbuf,81,stdin);
-				sscanf(inbuf,"%x ",&number_words) ;	
-			}
-						
-			if (num_args > 2) { // word count was also on the initial command
-				sscanf(argv[2],"%x",&number_words);
-			}
-				
+	if (scripted) {
+		printf("replay %s %llu %llu %llu %016llX\n",
+		  result.matched ? "match" : "diverged",
+		  (unsigned long long) result.events,
+		  (unsigned long long) result.mismatches,
+		  (unsigned long long) result.instructions,
+		  (unsigned long long) result.hash);
+	}
+	else {
+		printf("CONS> Replayed %llu characters, %llu out of step \n",
+		  (unsigned long long) result.events,
+		  (unsigned long long) result.mismatches);
+		printf("CONS> Instructions %llu, recorded %llu \n",
+		  (unsigned long long) result.instructions,
+		  (unsigned long long) result.expected_instructions);
+		printf("CONS> Hash %016llX, recorded %016llX \n",
+		  (unsigned long long) result.hash,
+		  (unsigned long long) result.expected_hash);
+	}
+	if (!result.matched) {
+		return Error("Replay diverged from the recording", name);
+	}
+	return 0;
+}
 
-			for (int i = 0; i < number_words; i++){ // do the dump
-				Print_memory_location(address);
-				address++;
-			}
+// Console method to run image files as a pipeline of new machines, each
+// sending on port 1 to the next one's port 0 through a channel.  The
+// first reads and the last writes the console as usual.
+int Console::Pipe(int num_args, char argv[MAX_ARGS][MAX_ARG_SIZE])
+{
+	machine_t *stages[MAX_ARGS] ;
+	machine_channel_t *channels[MAX_ARGS] ;
+	int statuses[MAX_ARGS] ;
+	int count = num_args - 1 ;
+	int made = 0 ;
+	int status = 0 ;
+
+	if (count < 1) {
+		return Error("Usage: pipe file file ...", argv[0]);
+	}
+	for (; made < count; made++) { // machines, and the channels into them
+		channels[made] = NULL ;
+		stages[made] = machine_create() ;
+		if (stages[made] == NULL) {
+			status = Error("Unable to create the machine", argv[made + 1]);
+			break;
+		}
+		if (scripted) {
+			machine_set_io(stages[made], NULL, Script_write, NULL);
+		}
+		if (machine_load_image(stages[made], argv[made + 1], 0) != MACHINE_OK) {
+			status = Error("Unable to load", argv[made + 1]);
+			made++ ;
+			break;
 		}
+		if (made == 0) {
+			continue;
+		}
+		channels[made] = machine_channel_create(0x1000) ;
+		if (channels[made] == NULL ||
+		  machine_connect(stages[made - 1], 1, channels[made], MACHINE_CHANNEL_SEND) != MACHINE_OK ||
+		  machine_connect(stages[made], 0, channels[made], MACHINE_CHANNEL_RECEIVE) != MACHINE_OK) {
+			status = Error("Unable to connect", argv[made + 1]);
+			made++ ;
+			break;
+		}
+	}
 
-// "dm" deposit memory command
-		else if (strcmp(argv[0],"dm") == 0) { // deposit memory
-			int address;
-			int value;
-			char inbuf[21];
-			char* pointer_string;
-			
-			if (num_args > 1 ) { // memory address was on command line
-				sscanf(argv[1],"%x",&address);
-			}			
-			
-			else { // address not on command line, get it 
-					printf("CONS> enter beginning memory address> ") ;
-					fgets(inbuf,21,stdin);
-					sscanf(inbuf,"%x ",&address) ;
+	if (status == 0) {
+		for (int i = 0; i < count; i++) {
+			statuses[i] = MACHINE_ERROR ; // if the group never starts
+		}
+		run_status = machine_run_group(stages, count, 0, statuses) == MACHINE_OK ?
+		  statuses[count - 1] : MACHINE_ERROR ;
+		ran = true ;
+		fflush(stdout) ;
+		for (int i = 0; i < count; i++) {
+			int32_t pc = machine_get_register(stages[i], MACHINE_PC_REGISTER) ;
+			if (scripted) {
+				printf("stage %d %d %08X\n",i,statuses[i],pc);
 			}
-			
-			if (num_args > 2) { // a single value was also supplied
-				sscanf(argv[2],"%x",&value) ;
-				Memory[address] = value;
+			else {
+				printf("CONS> Stage %d stopped at %08X status %d \n",i,pc,statuses[i]);
 			}
-			else { // need a series of values
-			
-				printf("CONS> enter consecutive memory values, break with return only \n");
-				printf("CONS %08X contents? > ",address);
-				
-				do {
-
-					pointer_string=fgets( inbuf,21,stdin);
-//					printf("String length is %d \n",strlen(pointer_string));
-					if (strlen(pointer_string) >1){
-						if (pointer_string != NULL)  {
-							sscanf(pointer_string,"%x",&value);
-							Memory[address] = value;
-							address++;
-							printf("CONS %08X contents? > ",address);
-						}
-
-					}	
-				
-				} while ( (pointer_string != NULL) && (strlen(pointer_string) > 1) );
-				// deposit loop terminates on empty line of return only or cntrl/d 
-			}	
-		} // end of "dm" hander
-		
-// "s" single instruction step command
-		else if (strcmp(argv[0],"s") == 0){ // step an instruction
-			cpu.Step();
 		}
-
-// "test" execute test code command
-		else if (strcmp(argv[0],"test") == 0) { //execute test routine
-			cpu.Test();
+	}
+	for (int i = 0; i < made; i++) {
+		if (stages[i] != NULL) {
+			machine_destroy(stages[i]) ;
+		}
+	}
+	for (int i = 0; i < made; i++) {
+		if (channels[i] != NULL) {
+			machine_channel_destroy(channels[i]) ;
 		}
+	}
+	return status;
+}
 
-// 
+// Console method to run all the cores and report how each one stopped
+void Console::Run_smp(uint64_t limit)
+{
+	int statuses[MACHINE_MAX_CORES] ;
+	int cores = machine_get_cores(vm) ;
+	run_status = machine_run_smp(vm, limit, statuses) ;
+	ran = true ;
+	for (int i = 0; i < cores; i++) {
+		machine_select_core(vm, i) ;
+		int32_t pc = machine_get_register(vm, MACHINE_PC_REGISTER) ;
+		if (scripted) {
+			printf("core %d %d %08X\n",i,statuses[i],pc);
+		}
+		else {
+			printf("CONS> Core %d stopped at %08X status %d \n",i,pc,statuses[i]);
+		}
+	}
+	if (run_status == MACHINE_WATCHPOINT) {
+		uint32_t watch_address ;
+		int watch_type ;
+		int core = machine_watch_hit(vm, &watch_address, &watch_type) ;
+		if (scripted) {
+			printf("watch %d %08X %s\n",core,watch_address,Watch_name(watch_type));
+		}
 		else {
-			printf("Command not found \n");
+			printf("CONS> Core %d hit watchpoint %08X %s \n",core,watch_address,
+			  watch_type == MACHINE_WATCH_READ ? "read" : "written");
 		}
+	}
+	machine_select_core(vm, current_core) ;
+}
 
-	} while (!finish);
-	
-	printf("Good day \n");
-	return 0; // return success
+// Console method to name a watchpoint type
+const char *Console::Watch_name(int type)
+{
+	switch (type) {
+		case MACHINE_WATCH_READ: return "r";
+		case MACHINE_WATCH_WRITE: return "w";
+		default: return "rw";
+	}
+}
 
-};
+// Console method to turn the last run status into a program exit code
+int Console::Exit_status()
+{
+	if (!ran) {
+		return EXIT_HALTED;
+	}
+	switch (run_status) {
+		case MACHINE_HALT: return EXIT_HALTED;
+		case 0: return EXIT_LIMIT;
+		case MACHINE_INVALID: return EXIT_INVALID;
+		case MACHINE_NOT_IMPLEMENTED: return EXIT_NOT_IMPLEMENTED;
+		case MACHINE_ADDRESS_FAULT: return EXIT_ADDRESS_FAULT;
+		case MACHINE_BREAKPOINT: return EXIT_BREAKPOINT;
+		case MACHINE_WATCHPOINT: return EXIT_WATCHPOINT;
+		case MACHINE_ERROR: return EXIT_RUN_ERROR;
+		default: return EXIT_COMMAND_ERROR;
+	}
+}
 
 // Console method to print a register
 void Console::Print_a_register(int reg_number)
 {
-	if ( (reg_number >= 0) && (reg_number <NUM_REGISTERS)) {
-		printf("CONS> Register %X = %08X \n",reg_number,
-		  cpu.Get_register_value(reg_number));
+	if ( (reg_number >= 0) && (reg_number <MACHINE_NUM_REGISTERS)) {
+		printf(scripted ? "%X %08X\n" : "CONS> Register %X = %08X \n",
+		  reg_number, machine_get_register(vm, reg_number));
 	}
 	else {
 		printf("Illegal register number \n");
@@ -873,23 +1121,23 @@ void Console::Print_a_register(int reg_number)
 void Console::Print_all_registers(void)
 {
 
-	for ( int i= 0;i<NUM_REGISTERS;i++) {
+	for ( int i= 0;i<MACHINE_NUM_REGISTERS;i++) {
 		Print_a_register(i);
 	}
 	return;
 };
 	
-// Console method to prompt for and get register number
+// Console method to prompt for and get register number, -1 if none
 int Console::Get_register_number(){
-	int regnum ;
+	uint32_t regnum ;
 	char inbuf[81] ;
 	while (true) {
 		
-		printf("CONS Register Number?> ");
-		fgets(inbuf,81,stdin);
-		sscanf(inbuf,"%x",&regnum);
-		if ( (regnum >= 0) && (regnum <NUM_REGISTERS)) {
-			return regnum;
+		if (!Ask("CONS Register Number?> ",inbuf,81)) {
+			return -1;
+		}
+		if (gethex(inbuf,&regnum) && regnum < MACHINE_NUM_REGISTERS) {
+			return (int) regnum;
 		}
 		else {
 			printf("Illegal register number \n");
@@ -897,20 +1145,103 @@ int Console::Get_register_number(){
 	}
 }
 
-// Console method to print a memory location
-void Console::Print_memory_location(int address){
-	printf("CONS> %08X %08X \n",address,Memory[address]);
+// Console method to print a memory location, -1 if it is outside memory
+int Console::Print_memory_location(uint32_t address){
+	int32_t value ;
+	if (machine_read_memory(vm, address, &value, 1) != MACHINE_OK) {
+		return -1;
+	}
+	printf(scripted ? "%08X %08X\n" : "CONS> %08X %08X \n",address,value);
+	return 0;
 }				
 
-// Mainline program - just turns control to the console until done 
+// Console method to load a text file of hex words, '#' starts a comment
+int Console::Load_hex(const char *path, uint32_t address){
+	FILE *input = fopen(path,"r");
+	if (input == NULL) {
+		return -1;
+	}
+	static int32_t words[MACHINE_MEMORY_SIZE] ;
+	uint32_t count = 0 ;
+	char line[LINE_SIZE] ;
+	while (fgets(line,LINE_SIZE,input) != NULL) {
+		char *comment = strchr(line,'#');
+		if (comment != NULL) {
+			*comment = 0;
+		}
+		for (char *token = strtok(line," \t\r\n,"); token != NULL;
+		  token = strtok(NULL," \t\r\n,")) {
+			if (count == MACHINE_MEMORY_SIZE) { // more words than memory
+				fclose(input);
+				return -1;
+			}
+			char *end ;
+			unsigned long word = strtoul(token,&end,16);
+			if (*end != 0 || word > 0xFFFFFFFFul) { // not all hex, or too big
+				fclose(input);
+				return Error("Illegal hex word", token);
+			}
+			words[count++] = (int32_t) word;
+		}
+	}
+	fclose(input);
+	return machine_write_memory(vm, address, words, count) == MACHINE_OK ? 0 : -1;
+}
 
+// Console method to write memory to a raw binary image file
+int Console::Save_image(const char *path, uint32_t address, uint32_t count){
+	static int32_t words[MACHINE_MEMORY_SIZE] ;
+	if (machine_read_memory(vm, address, words, count) != MACHINE_OK) {
+		return -1;
+	}
+	FILE *output = fopen(path,"wb");
+	if (output == NULL) {
+		return -1;
+	}
+	size_t written = fwrite(words, sizeof(int32_t), count, output);
+	return (fclose(output) == 0 && written == count) ? 0 : -1;
+}
+
+// Mainline program - turns control to the console until done.  With a
+// script file argument or -e commands the console runs them without
+// prompting and exits with a code telling how the last 'run' stopped.
 
-int main(void)
+int main(int argc, char *argv[])
 { 
-	printf ("Hello world \n");
-	Console cons ; // Create the console 
-	return cons.Start();
-	
-	
-}
+	if (argc < 2) { // interactive
+		printf ("Hello world \n");
+		Console cons(false) ; // Create the console 
+		return cons.Start();
+	}
 
+	Console cons(true) ; // scripted console
+	for (int i = 1; i < argc && !cons.Finished(); i++) {
+		if (strcmp(argv[i],"-e") == 0 && i + 1 < argc) { // inline command
+			char line[LINE_SIZE] ;
+			strncpy(line,argv[++i],LINE_SIZE - 1);
+			line[LINE_SIZE - 1] = 0;
+			if (cons.Command(line) != 0) {
+				return EXIT_COMMAND_ERROR;
+			}
+		}
+		else if (strcmp(argv[i],"-") == 0) { // script on standard input
+			if (cons.Script(stdin) != 0) {
+				return EXIT_COMMAND_ERROR;
+			}
+		}
+		else { // script file
+			FILE *script = fopen(argv[i],"r");
+			if (script == NULL) {
+				fprintf(stderr,"machine: Unable to open %s\n",argv[i]);
+				return EXIT_COMMAND_ERROR;
+			}
+			int status = cons.Script(script);
+			fclose(script);
+			if (status != 0) {
+				return EXIT_COMMAND_ERROR;
+			}
+		}
+	}
+	fflush(stdout);
+	return cons.Exit_status();
+}
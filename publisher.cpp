@@ -0,0 +1,118 @@
+/* publisher.cpp - writes a machine's counters into the shared telemetry
+ * segment, see telemetry.h for the layout.*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "publisher.h"
+
+static_assert(sizeof(telemetry_slot_t) == TELEMETRY_SLOT_SIZE,
+  "telemetry slots must fill their cache lines exactly");
+static_assert(offsetof(telemetry_segment_t, slot) == TELEMETRY_SLOT_SIZE,
+  "telemetry slots must start on a cache line");
+
+Publisher::Publisher() {
+	Segment = NULL;
+	Slot = NULL;
+}
+
+Publisher::~Publisher() {
+	Detach();
+}
+
+// Publisher method to map the segment, creating it if need be, and
+// claim a free slot.  Slots left behind by dead processes are reused.
+int Publisher::Attach(const char *name, const char *label) {
+	if (Slot != NULL) {
+		return -1;
+	}
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || ((size_t) info.st_size < sizeof(telemetry_segment_t) &&
+	  ftruncate(fd, sizeof(telemetry_segment_t)) != 0)) { // new segment, zero filled
+		close(fd);
+		return -1;
+	}
+	void *map = mmap(NULL, sizeof(telemetry_segment_t), PROT_READ | PROT_WRITE,
+	  MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	Segment = (telemetry_segment_t *) map;
+
+	uint32_t none = 0; // whoever gets here first sets up the header
+	if (__atomic_compare_exchange_n(&Segment->magic, &none, TELEMETRY_MAGIC, false,
+	  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		Segment->slots = TELEMETRY_SLOTS;
+		Segment->slot_size = TELEMETRY_SLOT_SIZE;
+	}
+	else if (none != TELEMETRY_MAGIC) { // something else is using the name
+		Detach();
+		return -1;
+	}
+
+	int32_t me = getpid();
+	for (int i = 0; i < TELEMETRY_SLOTS; i++) {
+		telemetry_slot_t *slot = &Segment->slot[i];
+		int32_t owner = 0;
+		if (!__atomic_compare_exchange_n(&slot->pid, &owner, me, false,
+		  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			if (kill(owner, 0) == 0 || errno != ESRCH) { // owner still alive
+				continue;
+			}
+			if (!__atomic_compare_exchange_n(&slot->pid, &owner, me, false,
+			  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				continue; // someone else took it over
+			}
+		}
+		Slot = slot;
+		telemetry_slot_t values;
+		memset(&values, 0, sizeof(values));
+		values.state = TELEMETRY_IDLE;
+		strncpy(values.label, label, TELEMETRY_LABEL_SIZE - 1);
+		Write(&values, sizeof(values));
+		return i;
+	}
+	Detach(); // segment full
+	return -1;
+}
+
+// Publisher method to give the slot back and unmap the segment
+void Publisher::Detach() {
+	if (Slot != NULL) {
+		__atomic_store_n(&Slot->pid, 0, __ATOMIC_RELEASE);
+		Slot = NULL;
+	}
+	if (Segment != NULL) {
+		munmap(Segment, sizeof(telemetry_segment_t));
+		Segment = NULL;
+	}
+}
+
+// Publisher method to update the counters in the slot, the label
+// stays as it was set by Attach
+void Publisher::Publish(const telemetry_slot_t *values) {
+	Write(values, offsetof(telemetry_slot_t, label));
+}
+
+// Publisher method to copy values into the slot from the state up to
+// end.  Readers see the sequence go odd, then even.
+void Publisher::Write(const telemetry_slot_t *values, size_t end) {
+	const size_t start = offsetof(telemetry_slot_t, state);
+	// we are the only writer, a dead owner may have left it odd
+	uint32_t sequence = (Slot->sequence + 1) | 1;
+	__atomic_store_n(&Slot->sequence, sequence, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((char *) Slot + start, (const char *) values + start, end - start);
+	__atomic_store_n(&Slot->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,33 @@
+/* publisher.h - writes a machine's counters into the shared telemetry
+ * segment.  Internal to the library, libmachine.h has the C interface
+ * and telemetry.h the segment layout.*/
+
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <stddef.h>
+#include "telemetry.h"
+
+//********************************************************************
+// Class to own one telemetry slot.  The segment is mapped once per
+// attach, after that publishing is plain stores into the mapping.
+//********************************************************************
+class Publisher
+{
+
+	public:
+		Publisher();	// Constructor
+		~Publisher();	// Destructor, frees the slot
+		int Attach(const char *name, const char *label); // claim a slot, returns its number
+		void Detach(); // free the slot and unmap
+		bool Attached() { return Slot != NULL; }
+		void Publish(const telemetry_slot_t *values); // seqlock update
+
+	private:
+
+		telemetry_segment_t *Segment;	// mapped segment, NULL if not attached
+		telemetry_slot_t *Slot;	// ours
+		void Write(const telemetry_slot_t *values, size_t end);
+};
+
+#endif
@@ -0,0 +1,241 @@
+/* replay.cpp - record and replay of the console input a guest reads,
+ * so a run that takes input can be repeated exactly.  See replay.h
+ * for the log format.*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+
+IoLog::IoLog() {
+	Mode = IO_LOG_IDLE;
+	Core = NULL;
+	Reader = NULL;
+	Writer = NULL;
+	Context = NULL;
+	File = NULL;
+	Data = NULL;
+}
+
+IoLog::~IoLog() {
+	if (File != NULL) {
+		fclose(File);
+	}
+	free(Data);
+}
+
+// IoLog method to start recording to a new log file
+int IoLog::Record(const char *path, CPU *core) {
+	if (Mode != IO_LOG_IDLE) {
+		return -1;
+	}
+	File = fopen(path, "wb");
+	if (File == NULL) {
+		return -1;
+	}
+	uint32_t magic = IO_LOG_MAGIC;
+	fwrite(&magic, sizeof(magic), 1, File);
+
+	Mode = IO_LOG_RECORDING;
+	Core = core;
+	Start = core->Instructions;
+	Last = 0;
+	Events = 0;
+	Mismatches = 0;
+	return 0;
+}
+
+// IoLog method to start feeding back a recorded log file
+int IoLog::Replay(const char *path, CPU *core) {
+	if (Mode != IO_LOG_IDLE) {
+		return -1;
+	}
+	FILE *input = fopen(path, "rb");
+	if (input == NULL) {
+		return -1;
+	}
+	fseek(input, 0, SEEK_END);
+	long size = ftell(input);
+	rewind(input);
+	if (size < (long) (sizeof(uint32_t) + IO_LOG_TRAILER)) { // not a log
+		fclose(input);
+		return -1;
+	}
+	Data = (uint8_t *) malloc(size);
+	if (Data == NULL || fread(Data, 1, size, input) != (size_t) size) {
+		fclose(input);
+		free(Data);
+		Data = NULL;
+		return -1;
+	}
+	fclose(input);
+
+	uint32_t magic, end;
+	uint8_t *trailer = &Data[size - IO_LOG_TRAILER];
+	memcpy(&magic, Data, sizeof(magic));
+	memcpy(&Expected_instructions, &trailer[0], sizeof(uint64_t));
+	memcpy(&Expected_hash, &trailer[8], sizeof(uint64_t));
+	memcpy(&end, &trailer[16], sizeof(end));
+	if (magic != IO_LOG_MAGIC || end != IO_LOG_END) { // not finished, or not a log
+		free(Data);
+		Data = NULL;
+		return -1;
+	}
+
+	Mode = IO_LOG_REPLAYING;
+	Core = core;
+	Start = core->Instructions;
+	Last = 0;
+	Events = 0;
+	Mismatches = 0;
+	Size = size - IO_LOG_TRAILER;
+	Position = sizeof(uint32_t);
+	return 0;
+}
+
+// IoLog method to keep the stamps going when Core's instruction count
+// is about to go back to zero, Start becomes what it will have been
+void IoLog::Counters_reset() {
+	if (Mode != IO_LOG_IDLE) {
+		Start -= Core->Instructions;
+	}
+}
+
+// IoLog method to finish logging.  A recording gets its trailer, a
+// replay is checked against it.  Returns 0 if recorded or matched.
+int IoLog::Stop(uint64_t hash, machine_replay_result_t *result) {
+	uint64_t instructions = Core->Instructions - Start;
+	int status = 0;
+
+	if (Mode == IO_LOG_RECORDING) {
+		uint32_t end = IO_LOG_END;
+		fwrite(&instructions, sizeof(instructions), 1, File);
+		fwrite(&hash, sizeof(hash), 1, File);
+		fwrite(&end, sizeof(end), 1, File);
+		if (ferror(File)) {
+			status = -1;
+		}
+		if (fclose(File) != 0) {
+			status = -1;
+		}
+		File = NULL;
+		Expected_instructions = instructions;
+		Expected_hash = hash;
+	}
+	else if (Mode == IO_LOG_REPLAYING) {
+		uint64_t delta;
+		int c;
+		while (Next_event(&delta, &c)) { // recorded input never read
+			Mismatches++;
+		}
+		free(Data);
+		Data = NULL;
+		if (Mismatches != 0 || instructions != Expected_instructions ||
+		  hash != Expected_hash) {
+			status = -1;
+		}
+	}
+	else {
+		return -1; // not logging
+	}
+
+	if (result != NULL) {
+		result->matched = status == 0;
+		result->events = Events;
+		result->mismatches = Mismatches;
+		result->instructions = instructions;
+		result->expected_instructions = Expected_instructions;
+		result->hash = hash;
+		result->expected_hash = Expected_hash;
+	}
+	Mode = IO_LOG_IDLE;
+	return status;
+}
+
+// IoLog method to set the real I/O hooks, NULL means stdio
+void IoLog::Set_io(Read_hook reader, Write_hook writer, void *context) {
+	Reader = reader;
+	Writer = writer;
+	Context = context;
+}
+
+// Read hook, gets the character from the real input or the log
+int IoLog::Read(void *context) {
+	IoLog *log = (IoLog *) context;
+	return log->Mode == IO_LOG_REPLAYING ? log->Replay_char() : log->Record_char();
+}
+
+// Write hook, output always goes through
+void IoLog::Write(void *context, int c) {
+	IoLog *log = (IoLog *) context;
+	if (log->Writer != NULL) {
+		log->Writer(log->Context, c);
+	}
+	else {
+		putchar(c);
+	}
+}
+
+// IoLog method to read a real character and log it
+int IoLog::Record_char() {
+	int c = (Reader != NULL) ? Reader(Context) : getchar();
+	uint64_t now = Core->Instructions - Start;
+	uint64_t value = (now - Last) << 1 | (c == EOF);
+	Last = now;
+	Events++;
+
+	while (value >= 0x80) { // varint, low 7 bits first
+		putc((int) (value & 0x7F) | 0x80, File);
+		value >>= 7;
+	}
+	putc((int) value, File);
+	if (c != EOF) {
+		putc(c & 0xFF, File);
+	}
+	return c;
+}
+
+// IoLog method to feed back the next logged character
+int IoLog::Replay_char() {
+	uint64_t delta;
+	int c;
+	if (!Next_event(&delta, &c)) { // reading more than was recorded
+		Mismatches++;
+		return EOF;
+	}
+	Last += delta;
+	if (Last != Core->Instructions - Start) { // run has gone another way
+		Mismatches++;
+	}
+	Events++;
+	return c;
+}
+
+// IoLog method to decode the next event of a replay
+bool IoLog::Next_event(uint64_t *delta, int *c) {
+	uint64_t value = 0;
+	int shift = 0;
+	while (true) {
+		if (Position >= Size || shift > 63) { // end, or a damaged log
+			Position = Size;
+			return false;
+		}
+		uint8_t byte = Data[Position++];
+		value |= (uint64_t) (byte & 0x7F) << shift;
+		shift += 7;
+		if ((byte & 0x80) == 0) {
+			break;
+		}
+	}
+	*delta = value >> 1;
+	if (value & 1) {
+		*c = EOF;
+	}
+	else if (Position < Size) {
+		*c = Data[Position++];
+	}
+	else {
+		return false;
+	}
+	return true;
+}
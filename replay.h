@@ -0,0 +1,75 @@
+/* replay.h - record and replay of the console input a guest reads.
+ * Internal to the library, libmachine.h has the C interface.
+ *
+ * Log format, host byte order like the memory images:
+ *   uint32_t IO_LOG_MAGIC
+ *   events, one per character read:
+ *     varint ((instructions since the last event) << 1 | end of input)
+ *     the character, left out for end of input
+ *   trailer, IO_LOG_TRAILER bytes:
+ *     uint64_t instructions run while recording
+ *     uint64_t state hash when recording stopped
+ *     uint32_t IO_LOG_END
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "cpu.h"
+#include "libmachine.h"
+
+#define IO_LOG_MAGIC 0x314F494D // "MIO1"
+#define IO_LOG_END 0x454F494D // "MIOE"
+#define IO_LOG_TRAILER 20 // bytes after the events
+
+#define IO_LOG_IDLE 0
+#define IO_LOG_RECORDING 1
+#define IO_LOG_REPLAYING 2
+
+//********************************************************************
+// Class to record or replay console input.  It sits between the CPU
+// and the real I/O hooks, which it passes output (and when recording,
+// input) through to.  Each character is stamped with the instruction
+// count of the core that was selected when logging started, so replay
+// is exact for single core runs.
+//********************************************************************
+class IoLog
+{
+
+	public:
+		IoLog();	// Constructor
+		~IoLog();	// Destructor, closes any log without a trailer
+		int Record(const char *path, CPU *core); // start a new log
+		int Replay(const char *path, CPU *core); // feed back an old one
+		int Stop(uint64_t hash, machine_replay_result_t *result); // finish and check
+		void Counters_reset(); // call before Core's counters are zeroed
+		void Set_io(Read_hook reader, Write_hook writer, void *context); // real hooks
+		int Get_mode() { return Mode; } // IO_LOG_IDLE, RECORDING or REPLAYING
+		CPU *Get_core() { return Core; } // stamping core, while not idle
+		static int Read(void *context); // hooks for the CPU, context is the IoLog
+		static void Write(void *context, int c);
+
+	private:
+
+		int Mode;
+		CPU *Core;	// its instruction count stamps the characters
+		uint64_t Start;	// Core's instruction count when logging started
+		uint64_t Last;	// stamp of the previous character
+		uint64_t Events;	// characters logged or fed back
+		uint64_t Mismatches;	// characters fed back at the wrong time
+		Read_hook Reader;	// real console input, NULL for stdin
+		Write_hook Writer;	// real console output, NULL for stdout
+		void *Context;	// passed back to the real hooks
+		FILE *File;	// log being recorded
+		uint8_t *Data;	// log being replayed
+		size_t Size;	// where its events end
+		size_t Position;	// next event
+		uint64_t Expected_instructions;	// from its trailer
+		uint64_t Expected_hash;
+		int Record_char();
+		int Replay_char();
+		bool Next_event(uint64_t *delta, int *c); // decode, false at the end
+};
+
+#endif
@@ -0,0 +1,71 @@
+/* telemetry.h - layout of the shared memory segment running machines
+ * publish their counters in.  Shared by the library, which writes it,
+ * and readers like machine-top, which only map it.
+ *
+ * Each machine owns one cache line aligned slot and is its only
+ * writer.  Slots are seqlocks: the sequence is odd while the owner is
+ * writing, so a reader copies the slot and tries again if the sequence
+ * changed under it.  Nothing is written per instruction, the library
+ * publishes between slices of a run.*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define TELEMETRY_NAME "/machine-telemetry" // default POSIX shared memory name
+#define TELEMETRY_MAGIC 0x314D4C54 // "TLM1"
+#define TELEMETRY_SLOTS 64 // machines that can publish at once
+#define TELEMETRY_SLOT_SIZE 128 // two cache lines, no false sharing
+#define TELEMETRY_LABEL_SIZE 32
+#define TELEMETRY_SLICE 0x100000 // instructions run between updates
+
+#define TELEMETRY_IDLE 0 // created but not run yet
+#define TELEMETRY_RUNNING 1 // inside a run
+#define TELEMETRY_STOPPED 2 // last run stopped, status says why
+
+typedef struct telemetry_slot {
+	uint32_t sequence; // odd while the owner is writing
+	int32_t pid; // owning process, 0 for a free slot
+	uint32_t state; // TELEMETRY_IDLE, RUNNING or STOPPED
+	int32_t status; // how the last run stopped, a MACHINE_* code
+	uint32_t pc; // of the selected core
+	uint32_t cores;
+	uint64_t instructions; // retired, all cores
+	uint64_t bytes_in; // console characters and block device bytes read
+	uint64_t bytes_out; // and written
+	uint64_t faults; // runs stopped by invalid instructions or bad addresses
+	uint64_t runs; // runs and steps
+	double run_seconds; // host time spent running
+	char label[TELEMETRY_LABEL_SIZE]; // set when the slot is claimed
+	uint8_t reserved[TELEMETRY_SLOT_SIZE - 104];
+} telemetry_slot_t;
+
+typedef struct telemetry_segment {
+	uint32_t magic; // TELEMETRY_MAGIC once set up
+	uint32_t slots; // TELEMETRY_SLOTS
+	uint32_t slot_size; // TELEMETRY_SLOT_SIZE
+	uint8_t reserved[TELEMETRY_SLOT_SIZE - 12];
+	telemetry_slot_t slot[TELEMETRY_SLOTS];
+} telemetry_segment_t;
+
+/* take a consistent copy of a slot, returns 0 or -1 if the owner kept
+ * writing */
+static inline int telemetry_read(const telemetry_slot_t *slot,
+  telemetry_slot_t *copy) {
+	for (int tries = 0; tries < 1000; tries++) {
+		uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if (before & 1) { // being written
+			continue;
+		}
+		memcpy(copy, (const void *) slot, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before) {
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#endif